@@ -0,0 +1,78 @@
+#include "Audio.h"
+
+const float AMPLITUDE { 30000 };
+
+Chip8Audio::Chip8Audio(const Chip8& chip) : chip(chip)
+{
+    // One cycle of the old beep: the tone plus four octaves, falling off by half
+    for (unsigned int i = 0; i < WAVETABLE_SIZE; i++) {
+        double t = 2 * M_PI * i / WAVETABLE_SIZE;
+        double y = sin(t) + sin(2 * t) / 2 + sin(4 * t) / 4 + sin(8 * t) / 8 + sin(16 * t) / 16;
+        wavetable[i] = sf::Int16(y / 2 * AMPLITUDE);
+    }
+
+    samplesPerTick = AUDIO_SAMPLE_RATE / 60;
+    gatedSamples = chip.soundTicks() * samplesPerTick;
+    phase = 0;
+    toneStep = uint32_t(TONE_FREQUENCY / AUDIO_SAMPLE_RATE * 4294967296.0);
+    patternEnabled = false;
+    patternStep = 0;
+    std::fill(std::begin(pattern), std::end(pattern), 0);
+
+    initialize(1, AUDIO_SAMPLE_RATE);
+}
+
+// The stream thread calls back into this object, stop it before members go away
+Chip8Audio::~Chip8Audio()
+{
+    stop();
+}
+
+void Chip8Audio::setPattern(const uint8_t bits[16], uint8_t pitch)
+{
+    double rate = 4000 * std::pow(2.0, (pitch - 64) / 48.0);
+    std::lock_guard<std::mutex> guard(patternLock);
+    std::copy(bits, bits + 16, pattern);
+    // The top 7 bits of phase pick one of the 128 pattern bits
+    patternStep = uint32_t(rate / AUDIO_SAMPLE_RATE * 33554432.0);
+    patternEnabled = true;
+}
+
+void Chip8Audio::clearPattern()
+{
+    std::lock_guard<std::mutex> guard(patternLock);
+    patternEnabled = false;
+}
+
+bool Chip8Audio::onGetData(Chunk& data)
+{
+    uint64_t owed = chip.soundTicks() * samplesPerTick;
+    if (owed > gatedSamples + MAX_SOUND_BACKLOG * samplesPerTick) {
+        gatedSamples = owed - MAX_SOUND_BACKLOG * samplesPerTick;
+    }
+
+    std::lock_guard<std::mutex> guard(patternLock);
+    for (unsigned int i = 0; i < AUDIO_CHUNK_SAMPLES; i++) {
+        if (gatedSamples >= owed) {
+            samples[i] = 0;
+        } else if (patternEnabled) {
+            unsigned int bit = phase >> 25;
+            samples[i] = (pattern[bit >> 3] >> (7 - (bit & 7)) & 1) ? AMPLITUDE / 2 : -AMPLITUDE / 2;
+            phase += patternStep;
+            gatedSamples++;
+        } else {
+            samples[i] = wavetable[phase >> 24];
+            phase += toneStep;
+            gatedSamples++;
+        }
+    }
+
+    data.samples = samples;
+    data.sampleCount = AUDIO_CHUNK_SAMPLES;
+    return true;
+}
+
+// A live stream has nothing to seek
+void Chip8Audio::onSeek(sf::Time)
+{
+}
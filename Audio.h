@@ -0,0 +1,47 @@
+#pragma once
+
+#include <SFML/Audio.hpp>
+#include <mutex>
+#include "Chip8.h"
+
+const unsigned int AUDIO_SAMPLE_RATE { 44100 };
+const unsigned int AUDIO_CHUNK_SAMPLES { 512 };
+const unsigned int WAVETABLE_SIZE { 256 };
+const float TONE_FREQUENCY { 880 }; // A5
+// Sound ticks the stream may lag behind the core before the backlog is dropped
+const unsigned int MAX_SOUND_BACKLOG { 4 };
+
+// Streams the buzzer. Every 60 Hz tick the core spends with its sound timer
+// running becomes exactly sampleRate / 60 samples of tone, so the gate is
+// sample accurate and the core's timer is never touched. The tone comes from
+// a one-cycle wavetable built at startup; an XO-CHIP 16-byte pattern can
+// replace it.
+class Chip8Audio : public sf::SoundStream
+{
+    public:
+        explicit Chip8Audio(const Chip8& chip);
+        ~Chip8Audio();
+
+        // Play a 128-bit pattern at 4000 * 2^((pitch - 64) / 48) bits per second
+        void setPattern(const uint8_t pattern[16], uint8_t pitch = 64);
+        void clearPattern();
+
+    private:
+        const Chip8& chip;
+        sf::Int16 wavetable[WAVETABLE_SIZE];
+        sf::Int16 samples[AUDIO_CHUNK_SAMPLES];
+
+        // Samples of tone owed and played, counted in ticks * samplesPerTick
+        uint64_t gatedSamples;
+        unsigned int samplesPerTick;
+        uint32_t phase;
+        uint32_t toneStep;
+
+        std::mutex patternLock;
+        bool patternEnabled;
+        uint8_t pattern[16];
+        uint32_t patternStep;
+
+        bool onGetData(Chunk& data) override;
+        void onSeek(sf::Time timeOffset) override;
+};
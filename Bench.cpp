@@ -0,0 +1,280 @@
+#include "Chip8.h"
+#include <filesystem>
+#include <iomanip>
+
+// chip8-bench: the regression suite. Runs every ROM in roms/ headless for a
+// fixed number of frames with the same scripted key presses, then three
+// synthetic programs that each hammer one part of the core, and writes the
+// results as JSON so runs can be compared over time.
+//
+//     chip8-bench [--frames N] [--cpf N] [--jit] [--quirks] [--seed N] [--no-idle]
+//                 [--repeat N] [--filter text] [--out results.json]
+//
+// Every benchmark starts from a fresh machine. --repeat runs each one N times
+// and keeps the fastest run. --filter only runs benchmarks whose name
+// contains the text. Without --out the JSON goes to stdout, with it a
+// summary table does.
+
+struct BenchConfig
+{
+    uint32_t frames = 3600;
+    unsigned int cyclesPerFrame = DEFAULT_CYCLES_PER_FRAME;
+    bool useJit = false;
+    bool quirks = false;
+    uint64_t seed = 0;
+    bool idleSkipping = true;
+    unsigned int repeat = 1;
+};
+
+struct BenchResult
+{
+    std::string name;
+    std::string kind;
+    uint32_t frames = 0;
+    uint64_t instructions = 0;
+    uint64_t idleCycles = 0;
+    double seconds = 0;
+    double p50FrameNs = 0;
+    double p99FrameNs = 0;
+    double maxFrameNs = 0;
+    bool halted = false;
+};
+
+struct Synthetic
+{
+    const char* name;
+    std::vector<uint16_t> program;
+};
+
+// Each loops forever and keeps changing V, so idle skipping never applies
+static std::vector<Synthetic> synthetics()
+{
+    return {
+        // Two 5-row font sprites per trip at drifting, mostly unaligned positions
+        { "synthetic-dxyn", {
+            0x6000,         // 200: V0 = 0
+            0x6100,         // 202: V1 = 0
+            0x6200,         // 204: V2 = 0
+            0x630F,         // 206: V3 = 0x0F
+            0xF229,         // 208: I = font(V2)
+            0xD015,         // 20A: draw at V0, V1
+            0xD105,         // 20C: draw at V1, V0
+            0x7007,         // 20E: V0 += 7
+            0x7103,         // 210: V1 += 3
+            0x7201,         // 212: V2 += 1
+            0x8232,         // 214: V2 &= V3
+            0x1208,         // 216: jump 208
+        } },
+        // Every 8XYN form plus 7XNN and a skip
+        { "synthetic-alu", {
+            0x6001,         // 200: V0 = 1
+            0x6103,         // 202: V1 = 3
+            0x8014,         // 204: V0 += V1
+            0x8105,         // 206: V1 -= V0
+            0x8201,         // 208: V2 |= V0
+            0x8312,         // 20A: V3 &= V1
+            0x8423,         // 20C: V4 ^= V2
+            0x8506,         // 20E: V5 = V0 >> 1
+            0x860E,         // 210: V6 = V0 << 1
+            0x8757,         // 212: V7 = V5 - V7
+            0x8840,         // 214: V8 = V4
+            0x7911,         // 216: V9 += 0x11
+            0x3900,         // 218: skip if V9 == 0
+            0x7A01,         // 21A: VA += 1
+            0x1204,         // 21C: jump 204
+        } },
+        // Three nested calls and returns per trip
+        { "synthetic-call", {
+            0x2206,         // 200: call 206
+            0x7B01,         // 202: VB += 1
+            0x1200,         // 204: jump 200
+            0x220C,         // 206: call 20C
+            0x00EE,         // 208: return
+            0x0000,         // 20A:
+            0x2212,         // 20C: call 212
+            0x00EE,         // 20E: return
+            0x0000,         // 210:
+            0x7001,         // 212: V0 += 1
+            0x00EE,         // 214: return
+        } },
+    };
+}
+
+static BenchResult runOnce(const BenchConfig& config, const std::vector<uint8_t>& bytes,
+                           const std::vector<uint16_t>& script)
+{
+    auto chip = std::make_unique<Chip8>();
+    chip->setQuirks(config.quirks);
+    chip->seed(config.seed);
+    chip->idleSkipping = config.idleSkipping;
+    if (config.useJit) chip->setJit(true);
+    chip->cyclesPerFrame = config.cyclesPerFrame;
+    chip->loadBytes(bytes.data(), bytes.size());
+
+    std::vector<float> samples;
+    samples.reserve(config.frames);
+
+    BenchResult result;
+    auto start = std::chrono::steady_clock::now();
+    auto frameStart = start;
+    for (uint32_t frame = 0; frame < config.frames && !chip->halt; frame++) {
+        chip->setKeys(script[frame]);
+        result.instructions += chip->runFrames(1);
+        auto frameEnd = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<float, std::nano>(frameEnd - frameStart).count());
+        frameStart = frameEnd;
+    }
+    result.seconds = std::chrono::duration<double>(frameStart - start).count();
+
+    result.frames = samples.size();
+    result.idleCycles = chip->idleCycles;
+    result.halted = chip->halt;
+    if (!samples.empty()) {
+        std::sort(samples.begin(), samples.end());
+        result.p50FrameNs = samples[samples.size() / 2];
+        result.p99FrameNs = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+        result.maxFrameNs = samples.back();
+    }
+    return result;
+}
+
+static BenchResult runBenchmark(const BenchConfig& config, const std::vector<uint8_t>& bytes,
+                                const std::vector<uint16_t>& script)
+{
+    BenchResult best = runOnce(config, bytes, script);
+    for (unsigned int i = 1; i < config.repeat; i++) {
+        BenchResult result = runOnce(config, bytes, script);
+        if (result.seconds < best.seconds) best = result;
+    }
+    return best;
+}
+
+static std::string jsonString(const std::string& text)
+{
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') quoted += '\\';
+        if (uint8_t(c) >= 0x20) quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static void writeJson(std::ostream& out, const BenchConfig& config, const std::vector<BenchResult>& results)
+{
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    out << std::setprecision(9);
+    out << "{\n";
+    out << "  \"benchmark\": \"chip8-bench\",\n";
+    out << "  \"timestamp\": " << std::chrono::duration_cast<std::chrono::seconds>(now).count() << ",\n";
+    out << "  \"config\": { \"frames\": " << config.frames << ", \"cycles_per_frame\": " << config.cyclesPerFrame
+        << ", \"jit\": " << (config.useJit ? "true" : "false") << ", \"quirks\": " << (config.quirks ? "true" : "false")
+        << ", \"idle_skipping\": " << (config.idleSkipping ? "true" : "false") << ", \"seed\": " << config.seed
+        << ", \"repeat\": " << config.repeat << " },\n";
+    out << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        double frames = std::max<uint32_t>(r.frames, 1);
+        out << (i ? "," : "") << "\n    { \"name\": " << jsonString(r.name) << ", \"kind\": " << jsonString(r.kind)
+            << ", \"frames\": " << r.frames << ", \"instructions\": " << r.instructions
+            << ", \"seconds\": " << r.seconds
+            << ", \"instr_per_s\": " << (r.seconds > 0 ? r.instructions / r.seconds : 0)
+            << ", \"ns_per_frame\": " << r.seconds * 1e9 / frames
+            << ", \"p50_frame_ns\": " << r.p50FrameNs << ", \"p99_frame_ns\": " << r.p99FrameNs
+            << ", \"max_frame_ns\": " << r.maxFrameNs
+            << ", \"idle_fraction\": " << double(r.idleCycles) / std::max<uint64_t>(r.instructions, 1)
+            << ", \"halted\": " << (r.halted ? "true" : "false") << " }";
+    }
+    out << "\n  ]\n}\n";
+}
+
+static void writeSummary(std::ostream& out, const std::vector<BenchResult>& results)
+{
+    out << std::left << std::setw(20) << "Benchmark" << std::right << std::setw(14) << "Instr/s"
+        << std::setw(12) << "ns/frame" << std::setw(12) << "p50 ns" << std::setw(12) << "p99 ns" << '\n';
+    for (const BenchResult& r : results) {
+        out << std::left << std::setw(20) << r.name << std::right << std::setw(14) << std::setprecision(4)
+            << r.instructions / r.seconds << std::setw(12) << std::setprecision(5)
+            << r.seconds * 1e9 / std::max<uint32_t>(r.frames, 1) << std::setw(12) << r.p50FrameNs
+            << std::setw(12) << r.p99FrameNs << (r.halted ? "  (halted)" : "") << '\n';
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    BenchConfig config;
+    std::string filter, outPath;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc) config.frames = std::stoul(argv[++i]);
+        else if (arg == "--cpf" && i + 1 < argc) config.cyclesPerFrame = std::stoul(argv[++i]);
+        else if (arg == "--jit") config.useJit = true;
+        else if (arg == "--quirks") config.quirks = true;
+        else if (arg == "--seed" && i + 1 < argc) config.seed = std::stoull(argv[++i]);
+        else if (arg == "--no-idle") config.idleSkipping = false;
+        else if (arg == "--repeat" && i + 1 < argc) config.repeat = std::stoul(argv[++i]);
+        else if (arg == "--filter" && i + 1 < argc) filter = argv[++i];
+        else if (arg == "--out" && i + 1 < argc) outPath = argv[++i];
+        else {
+            std::cout << "usage: chip8-bench [--frames N] [--cpf N] [--jit] [--quirks] [--seed N] [--no-idle]"
+                      << " [--repeat N] [--filter text] [--out results.json]" << '\n';
+            return 1;
+        }
+    }
+    if (config.cyclesPerFrame == 0 || config.repeat == 0) {
+        std::cout << "--cpf and --repeat have to be at least 1" << '\n';
+        return 1;
+    }
+
+    std::vector<std::string> roms;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator("roms", error)) {
+        if (entry.is_regular_file()) roms.push_back(entry.path().filename().string());
+    }
+    std::sort(roms.begin(), roms.end());
+
+    std::vector<uint16_t> script = randomKeyScript(config.frames, config.seed);
+    std::vector<BenchResult> results;
+    for (const std::string& rom : roms) {
+        if (rom.find(filter) == std::string::npos) continue;
+        std::vector<uint8_t> bytes;
+        if (!readROM(rom, bytes)) {
+            std::cout << "Error trying to open " << rom << '\n';
+            return 1;
+        }
+        BenchResult result = runBenchmark(config, bytes, script);
+        result.name = rom;
+        result.kind = "rom";
+        results.push_back(result);
+    }
+
+    // The synthetic programs run without input, a held key would change nothing
+    std::vector<uint16_t> noKeys(config.frames, 0);
+    for (const Synthetic& synthetic : synthetics()) {
+        if (std::string(synthetic.name).find(filter) == std::string::npos) continue;
+        std::vector<uint8_t> bytes;
+        for (uint16_t opcode : synthetic.program) {
+            bytes.push_back(opcode >> 8);
+            bytes.push_back(opcode & 0xFF);
+        }
+        BenchResult result = runBenchmark(config, bytes, noKeys);
+        result.name = synthetic.name;
+        result.kind = "synthetic";
+        results.push_back(result);
+    }
+
+    if (outPath.empty()) {
+        writeJson(std::cout, config, results);
+        return 0;
+    }
+
+    std::ofstream out(outPath);
+    writeJson(out, config, results);
+    if (out.fail()) {
+        std::cout << "Error trying to write " << outPath << '\n';
+        return 1;
+    }
+    writeSummary(std::cout, results);
+    std::cout << "Wrote " << results.size() << " results to " << outPath << '\n';
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include "Chip8.h"
+#include "Recompiled.h"
 
 Chip8::Chip8()
 {
@@ -6,12 +7,25 @@ Chip8::Chip8()
     sp = 0;
     I = 0;
     halt = false;
-    srand(time(nullptr));
-    drawFlag = false;
+    seed(std::random_device()());
     delayTimer = 0;
     soundTimer = 0;
-    shiftQuirk = false;
-    loadStoreQuirk = false;
+    cyclesPerFrame = DEFAULT_CYCLES_PER_FRAME;
+    cycleCount = 0;
+    frameCount = 0;
+    frameCycle = 0;
+    useProfile<CosmacVip>();
+    romHash = 0;
+    romSize = 0;
+    pageStoreId = 0;
+    std::fill(std::begin(pageIds), std::end(pageIds), NO_PAGE);
+    idleSkipping = true;
+    useRecompiled = true;
+    idleCycles = 0;
+    std::fill(std::begin(idleLength), std::end(idleLength), IDLE_UNKNOWN);
+
+    static const bool dispatchBuilt = buildDispatchTable();
+    (void)dispatchBuilt;
 
     int i = 0;
     while (i < FONTSET_SIZE) {
@@ -21,460 +35,1037 @@ Chip8::Chip8()
 }
 
 
-void Chip8::loadROM(std::string romName)
+// Read a ROM from the roms folder
+bool readROM(std::string romName, std::vector<uint8_t>& bytes)
+{
+    std::ifstream input("roms/" + romName, std::ios::binary);
+    if (input.fail()) return false;
+
+    bytes.assign((std::istreambuf_iterator<char>(input)), (std::istreambuf_iterator<char>()));
+    return true;
+}
+
+bool Chip8::loadROM(std::string romName)
 {
     std::cout << "Trying to load rom " << romName << '\n';
-    std::ifstream input(".\\roms\\" + romName, std::ios::binary);
+    std::vector<uint8_t> bytes;
 
-    if (input.fail()) {
+    if (!readROM(romName, bytes)) {
         std::cout << "Error trying to open " << romName << '\n';
-    } else {
-        std::vector<char> bytes((std::istreambuf_iterator<char>(input)), (std::istreambuf_iterator<char>()));
-        std::cout << "Roam loaded." << '\n' << '\n';
-        int index = 0;
-        int i = pc;
-        for (char c: bytes)
-        {
-            std::bitset<8> x(c);
-            //std::cout << x;
-            memory[i] = c;
-            index++;
-            i++;
-            if (index == 2)
-            {
-                index = 0;
-                //std::cout << '\n';
-            }
-        }
-   
-        input.close();
+        return false;
+    }
+
+    std::cout << "Roam loaded." << '\n' << '\n';
+    loadBytes(bytes.data(), bytes.size());
+    return true;
+}
+
+void Chip8::loadBytes(const uint8_t* data, size_t size)
+{
+    if (size > MEMORY_SIZE - pc) size = MEMORY_SIZE - pc;
+    detachProgram();
+
+    std::copy(data, data + size, memory + pc);
+    invalidate(pc, size);
+
+    romHash = hashBytes(data, size);
+    romSize = size;
+    findProgram();
+}
+
+// Look up a recompiled program built for the loaded ROM with the current quirk
+void Chip8::findProgram()
+{
+    if (!useRecompiled) return;
+    const RecompiledProgram* program = findRecompiled(romHash, romSize, shiftQuirk);
+    if (program && attachProgram(*program)) {
+        std::cout << "Using recompiled " << program->romName << '\n';
     }
-   
+}
+
+// Use ahead-of-time compiled blocks for the loaded ROM
+bool Chip8::attachProgram(const RecompiledProgram& program)
+{
+    if (program.romHash != romHash || program.romSize != romSize) return false;
+    if (program.shiftQuirk != shiftQuirk) return false;
+    // The profiled paths skip recompiled blocks but would trust their lengths
+    if (profileCounters) return false;
+
+    staticBlocks = std::make_unique<RecompiledBlock[]>(MEMORY_SIZE);
+    for (size_t i = 0; i < program.blockCount; i++) {
+        const RecompiledBlockEntry& entry = program.blocks[i];
+        staticBlocks[entry.address] = entry.run;
+        blockLength[entry.address] = entry.length;
+    }
+    return true;
+}
+
+// The program's block lengths were never decoded by buildBlock, drop them with it
+void Chip8::detachProgram()
+{
+    if (!staticBlocks) return;
+    staticBlocks.reset();
+    std::fill(std::begin(blockLength), std::end(blockLength), 0);
 }
 
 void Chip8::setQuirks(bool value) {
-    shiftQuirk = value;
-    loadStoreQuirk = value;
+    usePaths(value);
+    // Compiled blocks bake the shift quirk in, swap in the program built for the new one
+    if (jit) jit->flush();
+    detachProgram();
+    findProgram();
 }
 
-void Chip8::DecrementDelay(auto delayStart, auto delayDuration) {
-    while (!halt) {
-        auto now = std::chrono::steady_clock::now();
-        if ((now - delayStart).count() / 1000000.0 >= delayDuration.count()) {
-            //std::cout << (std::chrono::steady_clock::now() - delayStart).count() / 1000000.0 << " ms" << std::endl;
-            delayStart = now;
-            if (delayTimer > 0) delayTimer--;
-        }
+// See the STATE_*_AT offsets in Chip8.h for the layout
+size_t Chip8::saveState(uint8_t* buffer, size_t size) const {
+    static_assert(sizeof(I) == 2 && sizeof(pc) == 2 && sizeof(sp) == 2 && sizeof(stack) == 2 * STACK_SIZE
+                  && sizeof(video) == 8 * DISPLAY_HEIGHT && sizeof(cycleCount) == 8 && sizeof(frameCount) == 8
+                  && sizeof(random) == 8, "a field no longer matches its size in the STATE_*_AT layout");
+    if (size < STATE_SIZE) return 0;
+
+    uint32_t frameCycles = frameCycle;
+    putStateHeader(buffer, (shiftQuirk ? STATE_SHIFT_QUIRK_FLAG : 0) | (loadStoreQuirk ? STATE_LOAD_STORE_QUIRK_FLAG : 0)
+                           | (halt ? STATE_HALT_FLAG : 0));
+    putState(buffer, STATE_MEMORY_AT, memory);
+    putState(buffer, STATE_V_AT, V);
+    putState(buffer, STATE_I_AT, I);
+    putState(buffer, STATE_PC_AT, pc);
+    putState(buffer, STATE_SP_AT, sp);
+    putState(buffer, STATE_STACK_AT, stack);
+    putState(buffer, STATE_DELAY_AT, delayTimer);
+    putState(buffer, STATE_SOUND_AT, soundTimer);
+    putState(buffer, STATE_KEY_AT, key);
+    putState(buffer, STATE_VIDEO_AT, video);
+    putState(buffer, STATE_FRAME_CYCLE_AT, frameCycles);
+    putState(buffer, STATE_CYCLES_AT, cycleCount);
+    putState(buffer, STATE_FRAMES_AT, frameCount);
+    putState(buffer, STATE_RANDOM_AT, random);
+    return STATE_SIZE;
+}
+
+bool Chip8::loadState(const uint8_t* buffer, size_t size) {
+    uint16_t version;
+    if (size < STATE_SIZE || std::memcmp(buffer, "C8ST", 4) != 0) return false;
+    getState(buffer, STATE_VERSION_AT, version);
+    if (version != STATE_VERSION) return false;
+
+    uint8_t flags = buffer[STATE_FLAGS_AT];
+    if (bool(flags & STATE_SHIFT_QUIRK_FLAG) != shiftQuirk) setQuirks(flags & STATE_SHIFT_QUIRK_FLAG);
+    halt = flags & STATE_HALT_FLAG;
+
+    // Only drop the caches over bytes that actually differ, so restoring a
+    // checkpoint of the same program keeps its decoded, JIT and AOT blocks
+    updateMemory(0, buffer + STATE_MEMORY_AT, MEMORY_SIZE);
+
+    uint32_t frameCycles;
+    getState(buffer, STATE_V_AT, V);
+    getState(buffer, STATE_I_AT, I);
+    getState(buffer, STATE_PC_AT, pc);
+    getState(buffer, STATE_SP_AT, sp);
+    getState(buffer, STATE_STACK_AT, stack);
+    getState(buffer, STATE_DELAY_AT, delayTimer);
+    getState(buffer, STATE_SOUND_AT, soundTimer);
+    getState(buffer, STATE_KEY_AT, key);
+    getState(buffer, STATE_VIDEO_AT, video);
+    getState(buffer, STATE_FRAME_CYCLE_AT, frameCycles);
+    getState(buffer, STATE_CYCLES_AT, cycleCount);
+    getState(buffer, STATE_FRAMES_AT, frameCount);
+    getState(buffer, STATE_RANDOM_AT, random);
+    frameCycle = frameCycles;
+    if (sp > STACK_SIZE) sp = STACK_SIZE;
+
+    DirtyRegion everything { 0xFFFFFFFF, ~0ull };
+    dirty.add(everything);
+    unpublished.add(everything);
+    publishFrame();
+    return true;
+}
+
+Chip8State Chip8::fork(Chip8PageStore& store) {
+    if (pageStoreId != store.id()) {
+        std::fill(std::begin(pageIds), std::end(pageIds), NO_PAGE);
+        pageStoreId = store.id();
     }
+
+    Chip8State state;
+    for (unsigned int page = 0; page < MEMORY_PAGES; page++) {
+        if (pageIds[page] == NO_PAGE) pageIds[page] = store.add(memory + page * MEMORY_PAGE_SIZE);
+        state.pages[page] = pageIds[page];
+    }
+
+    std::copy(std::begin(video), std::end(video), state.video);
+    state.cycleCount = cycleCount;
+    state.frameCount = frameCount;
+    state.random = random;
+    state.frameCycle = frameCycle;
+    std::copy(std::begin(stack), std::end(stack), state.stack);
+    state.I = I;
+    state.pc = pc;
+    state.sp = sp;
+    std::copy(std::begin(V), std::end(V), state.V);
+    std::copy(std::begin(key), std::end(key), state.key);
+    state.delayTimer = delayTimer;
+    state.soundTimer = soundTimer;
+    state.flags = (shiftQuirk ? STATE_SHIFT_QUIRK_FLAG : 0) | (loadStoreQuirk ? STATE_LOAD_STORE_QUIRK_FLAG : 0)
+                  | (halt ? STATE_HALT_FLAG : 0);
+    return state;
 }
 
-void Chip8::startCycle(float period) {
-    auto periodDuration = std::chrono::duration<float, std::milli>(period);
-    auto delayDuration = std::chrono::duration<float, std::milli>(100.0/6.0);
-    
-    auto delayStart = std::chrono::steady_clock::now();
+void Chip8::restore(const Chip8State& state, const Chip8PageStore& store) {
+    if (pageStoreId != store.id()) {
+        std::fill(std::begin(pageIds), std::end(pageIds), NO_PAGE);
+        pageStoreId = store.id();
+    }
+
+    for (unsigned int page = 0; page < MEMORY_PAGES; page++) {
+        if (pageIds[page] == state.pages[page]) continue;
+        updateMemory(page * MEMORY_PAGE_SIZE, store.page(state.pages[page]), MEMORY_PAGE_SIZE);
+        pageIds[page] = state.pages[page];
+    }
+
+    if (bool(state.flags & STATE_SHIFT_QUIRK_FLAG) != shiftQuirk) setQuirks(state.flags & STATE_SHIFT_QUIRK_FLAG);
+    halt = state.flags & STATE_HALT_FLAG;
+    std::copy(std::begin(state.video), std::end(state.video), video);
+    cycleCount = state.cycleCount;
+    frameCount = state.frameCount;
+    random = state.random;
+    frameCycle = state.frameCycle;
+    std::copy(std::begin(state.stack), std::end(state.stack), stack);
+    I = state.I;
+    pc = state.pc;
+    sp = std::min<uint16_t>(state.sp, STACK_SIZE);
+    std::copy(std::begin(state.V), std::end(state.V), V);
+    std::copy(std::begin(state.key), std::end(state.key), key);
+    delayTimer = state.delayTimer;
+    soundTimer = state.soundTimer;
+
+    // Published at the next frame boundary, a search restores far more often than it shows
+    DirtyRegion everything { 0xFFFFFFFF, ~0ull };
+    dirty.add(everything);
+    unpublished.add(everything);
+}
+
+uint16_t Chip8::keyMask() const {
+    uint16_t mask = 0;
+    for (unsigned int i = 0; i < 16; i++) {
+        if (key[i]) mask |= 1 << i;
+    }
+    return mask;
+}
+
+template <typename Quirks>
+void Chip8::useProfile() {
+    shiftQuirk = Quirks::shiftQuirk;
+    loadStoreQuirk = Quirks::loadStoreQuirk;
+    instructionRunner = &Chip8::runInstruction<Quirks>;
+    blockRunner = &Chip8::runBlock<Quirks>;
+    instructionExecutor = &Chip8::executeInstruction<Quirks>;
+}
+
+void Chip8::usePaths(bool quirks) {
+    if (profileCounters) {
+        if (quirks) useProfile<Profiled<SuperChip>>();
+        else useProfile<Profiled<CosmacVip>>();
+    } else {
+        if (quirks) useProfile<SuperChip>();
+        else useProfile<CosmacVip>();
+    }
+}
+
+void Chip8::setProfiling(bool enabled) {
+    if (enabled && !profileCounters) profileCounters = std::make_unique<Chip8Profile>();
+    if (!enabled) profileCounters.reset();
+    if (enabled) detachProgram();
+    usePaths(shiftQuirk);
+}
+
+// Run hot blocks as native code, returns false when the host has no JIT backend
+bool Chip8::setJit(bool enabled) {
+    if (!enabled) {
+        jit.reset();
+        return true;
+    }
+    if (!Chip8Jit::supported()) return false;
+    if (!jit) jit = std::make_unique<Chip8Jit>();
+    return true;
+}
+
+// Sleep until an absolute deadline so oversleeping one frame doesn't push back the next
+static void sleepUntil(std::chrono::steady_clock::time_point deadline) {
+#ifdef __linux__
+    auto sinceEpoch = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+    timespec target;
+    target.tv_sec = sinceEpoch / 1000000000;
+    target.tv_nsec = sinceEpoch % 1000000000;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, nullptr) == EINTR) {}
+#else
+    std::this_thread::sleep_until(deadline);
+#endif
+}
 
-    std::thread delayThread([delayStart, delayDuration, this]() {
-        DecrementDelay(delayStart, delayDuration);
-    });
+// Run in real time: each 60 Hz tick runs one frame of instructions and the
+// timers, then sleeps until the tick's deadline
+void Chip8::startCycle(float period) {
+    using namespace std::chrono;
+    const auto frameDuration = duration_cast<steady_clock::duration>(duration<double, std::milli>(FRAME_PERIOD_MS));
+    cyclesPerFrame = std::max(1, int(std::lround(FRAME_PERIOD_MS / period)));
+    schedulerStats = SchedulerStats();
 
     std::cout << "Cycled started" << '\n';
+    auto deadline = steady_clock::now();
     while(!halt) {
-        auto start = std::chrono::steady_clock::now();
-
         //std::cout << std::hex << "PC " << pc << '\n';
         //std::cout << std::hex << "I " << I << '\n';
         //std::cout << std::hex << "SP "<< sp << '\n';
-        //std::cout << "DrawFlag " << drawFlag << '\n';
 
-        executeNextInstruction();
+        if (!frameHook || frameHook(*this)) runFrames(1);
+        schedulerStats.frames++;
+
+        deadline += frameDuration;
+        auto now = steady_clock::now();
+        if (now > deadline + frameDuration * MAX_FRAMES_BEHIND) {
+            // Too far behind to catch up without a burst, drop the backlog
+            schedulerStats.resyncs++;
+            schedulerStats.driftCorrectedMs += duration<double, std::milli>(now - deadline).count();
+            deadline = now;
+            continue;
+        }
 
-        while ((periodDuration - (std::chrono::steady_clock::now() - start)).count() > 0) {}
-        //std::cout << (std::chrono::steady_clock::now() - start).count() / 1000000.0 << " ms" << std::endl;
+        sleepUntil(deadline);
+        double late = duration<double, std::milli>(steady_clock::now() - deadline).count();
+        schedulerStats.driftCorrectedMs += late;
+        schedulerStats.maxLateMs = std::max(schedulerStats.maxLateMs, late);
+        //std::cout << late << " ms late" << std::endl;
     }
 
     std::cout << "Cycled stopped" << '\n';
+    std::cout << schedulerStats.frames << " frames, " << schedulerStats.driftCorrectedMs << " ms of drift corrected, "
+              << schedulerStats.maxLateMs << " ms worst wakeup, " << schedulerStats.resyncs << " resyncs" << '\n';
+}
+
+// Run n instructions as fast as possible, ticking the timers every
+// cyclesPerFrame instructions. Returns the number executed, less than n on halt.
+//
+// Busy waits are skipped. Inside a frame the delay timer and the keys are
+// constant, so a short loop that only reads them and writes V and I repeats
+// exactly once one trip around it leaves V and I unchanged. Every further
+// whole trip that fits in the frame is then counted without running it,
+// which covers FX0A waits, jumps to self and delay timer polls.
+uint64_t Chip8::runCycles(uint64_t n) {
+    uint64_t executed = 0;
+
+    const uint16_t NO_LOOP = 0xFFFF;
+    uint16_t idleHead = NO_LOOP, idleEnd = 0;
+    uint64_t idleMark = 0;
+    uint8_t idleV[REGISTERS_SIZE];
+    uint16_t idleI = 0;
+
+    while (executed < n && !halt) {
+        uint64_t budget = std::min<uint64_t>(cyclesPerFrame - frameCycle, n - executed);
+
+        if (idleHead != NO_LOOP) {
+            if (pc == idleHead && executed > idleMark) {
+                uint64_t trip = executed - idleMark;
+                if (I == idleI && std::equal(V, V + REGISTERS_SIZE, idleV)) {
+                    uint64_t skipped = budget / trip * trip;
+                    executed += skipped;
+                    cycleCount += skipped;
+                    frameCycle += skipped;
+                    idleCycles += skipped;
+                    budget -= skipped;
+                    if (budget == 0) {
+                        if (frameCycle >= cyclesPerFrame) {
+                            endFrame();
+                            idleHead = NO_LOOP;
+                        }
+                        continue;
+                    }
+                }
+                std::copy(V, V + REGISTERS_SIZE, idleV);
+                idleI = I;
+                idleMark = executed;
+            } else if (pc < idleHead || pc >= idleEnd) {
+                // Left the loop body
+                idleHead = NO_LOOP;
+            }
+        }
+        uint16_t start = pc;
+
+        unsigned int length = 0;
+        if (pc+1 < MEMORY_SIZE) {
+            length = blockLength[pc] ? blockLength[pc] : buildBlock(pc);
+        }
+
+        unsigned int ran;
+        if (length > 0 && length <= budget) {
+            ran = executeNextBlock();
+        } else {
+            executeNextInstruction();
+            ran = 1;
+        }
+
+        executed += ran;
+        cycleCount += ran;
+        frameCycle += ran;
+        if (frameCycle >= cyclesPerFrame) {
+            endFrame();
+            // The timers just changed, a loop has to prove itself idle again
+            idleHead = NO_LOOP;
+        } else if (pc <= start && idleHead == NO_LOOP && idleSkipping && !profileCounters && pc + 1 < MEMORY_SIZE) {
+            // A backward jump, see whether it closes an idle loop
+            uint8_t loop = (idleLength[pc] != IDLE_UNKNOWN) ? idleLength[pc] : scanIdleLoop(pc);
+            if (loop) {
+                idleHead = pc;
+                idleEnd = pc + 2 * loop;
+                std::copy(V, V + REGISTERS_SIZE, idleV);
+                idleI = I;
+                idleMark = executed;
+            }
+        }
+    }
+
+    // Don't leave the final screen of a halted program unpublished
+    if (halt && !unpublished.empty()) publishFrame();
+    return executed;
+}
+
+void Chip8::endFrame() {
+    frameCycle = 0;
+    frameCount++;
+    tickTimers();
+    if (!unpublished.empty()) publishFrame();
+    if (profileCounters) profileFrame();
+}
+
+// Run until n more frame boundaries have passed
+uint64_t Chip8::runFrames(uint32_t n) {
+    uint64_t executed = 0;
+    for (uint32_t i = 0; i < n && !halt; i++) {
+        executed += runCycles(cyclesPerFrame - frameCycle);
+    }
+    return executed;
+}
+
+void Chip8::tickTimers() {
+    if (delayTimer > 0) delayTimer--;
+    if (soundTimer > 0) {
+        soundTimer--;
+        soundTickCount.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void Chip8::publishFrame() {
+    frames.publish(video, unpublished);
+    unpublished = DirtyRegion();
 }
 
 void Chip8::executeNextInstruction() {
+    (this->*instructionRunner)();
+}
+
+unsigned int Chip8::executeNextBlock() {
+    return (this->*blockRunner)();
+}
+
+template <typename Quirks>
+void Chip8::runInstruction() {
     // Fetch
     if (pc+1 < MEMORY_SIZE) {
-        uint16_t instruction = (uint16_t(memory[pc]) << 8) | uint16_t(memory[pc+1]);
+        Instruction instruction = fetch(pc);
         pc += 2;
         //std::cout << "INSTRUCTION " << std::hex << instruction << '\n';
-        executeInstruction(instruction);
+        executeInstruction<Quirks>(instruction);
     } else {
         halt = true;
     }
 }
 
-void Chip8::executeInstruction(uint16_t instruction) {
+// Run the basic block at pc as one unit, returns the number of instructions executed
+template <typename Quirks>
+unsigned int Chip8::runBlock() {
+    if (pc+1 >= MEMORY_SIZE) {
+        halt = true;
+        return 0;
+    }
+
+    uint16_t start = pc;
+    if constexpr (!Quirks::profiling) {
+        if (staticBlocks && staticBlocks[start]) return staticBlocks[start](*this);
+        if (jit) {
+            JitBlock native = jit->blockAt(*this, start);
+            if (native) return native(this);
+        }
+    }
+
+    unsigned int length = blockLength[start];
+    if (length == 0) length = buildBlock(start);
+
+    for (unsigned int i = 0; i < length; i++) {
+        Instruction instruction = decoded[pc];
+        pc += 2;
+        executeInstruction<Quirks>(instruction);
+        // A write into the block itself ends it early
+        if (blockLength[start] == 0) return i + 1;
+    }
+
+    return length;
+}
+
+// Interpreter exit for compiled blocks: runs the instruction at the low half of
+// argument, returns non-zero when the block starting at the high half must stop
+uint32_t Chip8::jitExecute(Chip8* chip, uint32_t argument) {
+    uint16_t address = argument & 0xFFFF;
+    uint16_t start = argument >> 16;
+
+    Instruction instruction = chip->fetch(address);
+    chip->pc = address + 2;
+    (chip->*chip->instructionExecutor)(instruction);
+    return chip->halt || chip->blockLength[start] == 0;
+}
+
+Instruction& Chip8::fetch(uint16_t address) {
+    Instruction& instruction = decoded[address];
+    if (instruction.op == OP_UNDECODED) {
+        instruction = decodeInstruction((uint16_t(memory[address]) << 8) | uint16_t(memory[address+1]));
+    }
+    return instruction;
+}
+
+// Scan the straight-line run of instructions starting at address
+uint8_t Chip8::buildBlock(uint16_t address) {
+    uint8_t length = 0;
+    unsigned int next = address;
+    while (length < MAX_BLOCK_LENGTH && next+1 < MEMORY_SIZE) {
+        length++;
+        if (endsBlock(fetch(next).op)) break;
+        next += 2;
+    }
+
+    blockLength[address] = length;
+    return length;
+}
+
+// Length of the loop at address when it can be an idle loop: FX0A on its
+// own, or up to MAX_IDLE_LOOP idle-safe instructions closed by a jump back
+// to address. 0 when it can't.
+uint8_t Chip8::scanIdleLoop(uint16_t address) {
+    uint8_t length = 0;
+    if (fetch(address).op == OP_FX0A) {
+        length = 1;
+    } else {
+        for (unsigned int i = 0, at = address; i < MAX_IDLE_LOOP && at + 1 < MEMORY_SIZE; i++, at += 2) {
+            const Instruction& instruction = fetch(at);
+            if (instruction.op == OP_1NNN) {
+                if (instruction.operands.nnn == address) length = i + 1;
+                break;
+            }
+            if (!idleSafe(instruction.op)) break;
+        }
+    }
+
+    idleLength[address] = length;
+    return length;
+}
+
+// Instructions that only read V, I, memory, the delay timer and the keys,
+// and only write V, I and pc
+bool Chip8::idleSafe(uint8_t op) {
+    switch (op) {
+        case OP_NOP:
+        case OP_3XNN: case OP_4XNN: case OP_5XY0: case OP_9XY0:
+        case OP_6XNN: case OP_7XNN:
+        case OP_8XY0: case OP_8XY1: case OP_8XY2: case OP_8XY3: case OP_8XY4:
+        case OP_8XY5: case OP_8XY6: case OP_8XY7: case OP_8XYE:
+        case OP_ANNN:
+        case OP_EX9E: case OP_EXA1:
+        case OP_FX07: case OP_FX0A: case OP_FX1E: case OP_FX29: case OP_FX65:
+            return true;
+    }
+    return false;
+}
+
+// Instructions that can move pc somewhere other than the next instruction
+bool Chip8::endsBlock(uint8_t op) {
+    switch (op) {
+        case OP_HALT:
+        case OP_00EE:
+        case OP_1NNN:
+        case OP_2NNN:
+        case OP_3XNN:
+        case OP_4XNN:
+        case OP_5XY0:
+        case OP_9XY0:
+        case OP_BNNN:
+        case OP_EX9E:
+        case OP_EXA1:
+        case OP_FX0A:
+            return true;
+    }
+    return false;
+}
+
+// Drop cached decodes and blocks overlapping a write to [address, address + length),
+// which like I-relative accesses wraps at the end of memory
+void Chip8::invalidate(uint16_t address, uint16_t length) {
+    address &= 0xFFF;
+    if (address + length > MEMORY_SIZE) {
+        invalidate(0, address + length - MEMORY_SIZE);
+        length = MEMORY_SIZE - address;
+    }
+    unsigned int first = (address > 0) ? address - 1 : 0;
+    unsigned int last = address + length;
+    if (last > MEMORY_SIZE) last = MEMORY_SIZE;
+
+    // The next fork has to copy the pages this write touched
+    for (unsigned int page = address / MEMORY_PAGE_SIZE; page * MEMORY_PAGE_SIZE < last; page++) {
+        pageIds[page] = NO_PAGE;
+    }
+
+    for (unsigned int i = first; i < last; i++) {
+        decoded[i].op = OP_UNDECODED;
+    }
+
+    unsigned int firstBlock = (address >= 2 * MAX_BLOCK_LENGTH) ? address - 2 * MAX_BLOCK_LENGTH + 1 : 0;
+    std::fill(blockLength + firstBlock, blockLength + last, 0);
+    std::fill(idleLength + firstBlock, idleLength + last, IDLE_UNKNOWN);
+    if (jit) jit->invalidate(firstBlock, last);
+    if (staticBlocks) std::fill(staticBlocks.get() + firstBlock, staticBlocks.get() + last, nullptr);
+}
+
+// Copy data over memory at address, dropping the caches only where bytes differ.
+// Each run of differing chunks is invalidated once, from its first changed
+// byte to its last, so a rewritten page costs one invalidate, not one per byte run.
+void Chip8::updateMemory(unsigned int address, const uint8_t* data, unsigned int length) {
+    const unsigned int chunk = 64;
+    unsigned int first = 0, last = 0;
+    for (unsigned int base = 0; base < length; base += chunk) {
+        unsigned int end = std::min(base + chunk, length);
+        if (std::memcmp(memory + address + base, data + base, end - base) == 0) {
+            if (first < last) invalidate(address + first, last - first);
+            first = last = 0;
+            continue;
+        }
+
+        unsigned int from = base, to = end;
+        while (memory[address + from] == data[from]) from++;
+        while (memory[address + to - 1] == data[to - 1]) to--;
+        std::copy(data + from, data + to, memory + address + from);
+        if (first == last) first = from;
+        last = to;
+    }
+    if (first < last) invalidate(address + first, last - first);
+}
+
+template <typename Quirks>
+void Chip8::executeInstruction(Instruction instruction) {
+    Operands op = instruction.operands;
+    [[maybe_unused]] uint16_t address = pc - 2;
+    if constexpr (Quirks::profiling) profileInstruction(instruction, address);
+
+    switch (instruction.op) {
+        case OP_HALT: op_HALT(op); break;
+        case OP_NOP: op_NOP(op); break;
+        case OP_00E0: op_00E0(op); break;
+        case OP_00EE: op_00EE(op); break;
+        case OP_1NNN: op_1NNN(op); break;
+        case OP_2NNN: op_2NNN(op); break;
+        case OP_3XNN: op_3XNN(op); break;
+        case OP_4XNN: op_4XNN(op); break;
+        case OP_5XY0: op_5XY0(op); break;
+        case OP_6XNN: op_6XNN(op); break;
+        case OP_7XNN: op_7XNN(op); break;
+        case OP_8XY0: op_8XY0(op); break;
+        case OP_8XY1: op_8XY1(op); break;
+        case OP_8XY2: op_8XY2(op); break;
+        case OP_8XY3: op_8XY3(op); break;
+        case OP_8XY4: op_8XY4(op); break;
+        case OP_8XY5: op_8XY5(op); break;
+        case OP_8XY6: op_8XY6<Quirks>(op); break;
+        case OP_8XY7: op_8XY7(op); break;
+        case OP_8XYE: op_8XYE<Quirks>(op); break;
+        case OP_9XY0: op_9XY0(op); break;
+        case OP_ANNN: op_ANNN(op); break;
+        case OP_BNNN: op_BNNN(op); break;
+        case OP_CXNN: op_CXNN(op); break;
+        case OP_DXYN: op_DXYN(op); break;
+        case OP_EX9E: op_EX9E(op); break;
+        case OP_EXA1: op_EXA1(op); break;
+        case OP_FX07: op_FX07(op); break;
+        case OP_FX0A: op_FX0A(op); break;
+        case OP_FX15: op_FX15(op); break;
+        case OP_FX18: op_FX18(op); break;
+        case OP_FX1E: op_FX1E(op); break;
+        case OP_FX29: op_FX29(op); break;
+        case OP_FX33: op_FX33(op); break;
+        case OP_FX55: op_FX55<Quirks>(op); break;
+        case OP_FX65: op_FX65<Quirks>(op); break;
+    }
+    if constexpr (Quirks::profiling) profileControl(instruction.op, address);
+}
+
+// Count the instruction at address about to run, for the profiled paths
+void Chip8::profileInstruction(const Instruction& instruction, uint16_t address) {
+    Chip8Profile& profile = *profileCounters;
+    profile.opcodes[instruction.op]++;
+    profile.addresses[address % MEMORY_SIZE]++;
+    profile.frameInstructions++;
+
+    if (instruction.op == OP_DXYN) {
+        profile.sprites++;
+        profile.spriteRows += instruction.operands.n;
+        for (unsigned int row = 0; row < instruction.operands.n; row++) {
+            profile.spritePixels += std::popcount(memory[(I + row) & 0xFFF]);
+        }
+        profile.lastDraw = profile.frameInstructions;
+        profile.drew = true;
+    } else if (instruction.op == OP_2NNN) {
+        if (sp < STACK_SIZE) profile.callDepths[sp + 1]++;
+        else profile.stackOverflows++;
+    }
+}
+
+// Count a backward jump, skip or key wait out of the instruction that was at
+// address. Calls and returns are not loops, so they never count.
+void Chip8::profileControl(uint8_t op, uint16_t address) {
+    bool loopable = op == OP_1NNN || op == OP_BNNN || op == OP_FX0A ||
+                    op == OP_3XNN || op == OP_4XNN || op == OP_5XY0 || op == OP_9XY0 ||
+                    op == OP_EX9E || op == OP_EXA1;
+    if (loopable && pc <= address) {
+        profileCounters->backEdges[address % MEMORY_SIZE]++;
+        profileCounters->backTargets[address % MEMORY_SIZE] = pc;
+    }
+}
+
+void Chip8::profileFrame() {
+    Chip8Profile& profile = *profileCounters;
+    profile.frames++;
+    if (profile.drew) {
+        profile.drawingFrames++;
+        profile.lastDrawCycles += profile.lastDraw;
+        unsigned int bucket = uint64_t(profile.lastDraw) * DRAW_HISTOGRAM_BUCKETS / std::max(cyclesPerFrame, 1u);
+        profile.lastDrawHistogram[std::min(bucket, DRAW_HISTOGRAM_BUCKETS - 1)]++;
+    }
+    profile.frameInstructions = 0;
+    profile.drew = false;
+}
+
+uint8_t Chip8::dispatchTable[0x10000];
+
+bool Chip8::buildDispatchTable() {
+    for (uint32_t instruction = 0; instruction < 0x10000; instruction++) {
+        dispatchTable[instruction] = decode(instruction);
+    }
+    return true;
+}
+
+Instruction Chip8::decodeInstruction(uint16_t instruction) {
+    Instruction decodedInstruction;
+    decodedInstruction.operands.x = (instruction >> 8) & 0xF;
+    decodedInstruction.operands.y = (instruction >> 4) & 0xF;
+    decodedInstruction.operands.n = instruction & 0xF;
+    decodedInstruction.operands.nn = instruction & 0xFF;
+    decodedInstruction.operands.nnn = instruction & 0xFFF;
+    decodedInstruction.op = dispatchTable[instruction];
+    return decodedInstruction;
+}
+
+uint8_t Chip8::decode(uint16_t instruction) {
     uint8_t opcode = (instruction >> 12) & 0xF;
-    uint8_t x = (instruction >> 8) & 0xF;
-    uint8_t y = (instruction >> 4) & 0xF;
     uint8_t n = instruction & 0xF;
     uint8_t kk = instruction & 0xFF;
-    uint16_t nnn = instruction & 0xFFF;
 
     switch (opcode) {
         case 0x0:
             // CLS or RET
-            if (instruction == 0x00E0) {
-                op_00E0();
-                break;
-            } else if (instruction == 0x00EE) {
-                op_00EE();
-                break;
-            }
-            halt = true;
-            break;
+            if (instruction == 0x00E0) return OP_00E0;
+            if (instruction == 0x00EE) return OP_00EE;
+            return OP_HALT;
         case 0x1:
-            op_1NNN(instruction);
-            break;
+            return OP_1NNN;
         case 0x2:
-            op_2NNN(instruction);
-            break;
+            return OP_2NNN;
         case 0x3:
             // SE Vx, byte
-            op_3XNN(instruction);
-            break;
+            return OP_3XNN;
         case 0x4:
             // SNE Vx, byte
-            op_4XNN(instruction);
-            break;
+            return OP_4XNN;
         case 0x5:
             // SE Vx, Vy
-            op_5XY0(instruction);
-            break;
+            return OP_5XY0;
         case 0x6:
             // LD Vx, byte
-            op_6XNN(instruction);
-            break;
+            return OP_6XNN;
         case 0x7:
             // ADD Vx, byte
-            op_7XNN(instruction);
-            break;
+            return OP_7XNN;
         case 0x8:
             switch (n) {
                 case 0x0:
                     // LD Vx, Vy
-                    op_8XY0(instruction);
-                    break;
+                    return OP_8XY0;
                 case 0x1:
                     // OR Vx, Vy
-                    op_8XY1(instruction);
-                    break;
+                    return OP_8XY1;
                 case 0x2:
                     // AND Vx, Vy
-                    op_8XY2(instruction);
-                    break;
+                    return OP_8XY2;
                 case 0x3:
                     // XOR Vx, Vy
-                    op_8XY3(instruction);
-                    break;
+                    return OP_8XY3;
                 case 0x4:
                     // ADD Vx, Vy
-                    op_8XY4(instruction);
-                    break;
+                    return OP_8XY4;
                 case 0x5:
                     // SUB Vx, Vy
-                    op_8XY5(instruction);
-                    break;
+                    return OP_8XY5;
                 case 0x6:
                     // SHR Vx {, Vy}
-                    op_8XY6(instruction);
-                    break;
+                    return OP_8XY6;
                 case 0x7:
                     // SUBN Vx, Vy
-                    op_8XY7(instruction);
-                    break;
+                    return OP_8XY7;
                 case 0xE:
                     // SHL Vx {, Vy}
-                    op_8XYE(instruction);
-                    break;
+                    return OP_8XYE;
             }
-            break;
+            return OP_NOP;
         case 0x9:
             // SNE Vx, Vy
-            op_9XY0(instruction);
-            break;
+            return OP_9XY0;
         case 0xA:
             // LD I, addr
-            op_ANNN(instruction);
-            break;
+            return OP_ANNN;
         case 0xB:
             // JP V0, addr
-            op_BNNN(instruction);
-            break;
+            return OP_BNNN;
         case 0xC:
             // RND Vx, byte
-            op_CXNN(instruction);
-            break;
+            return OP_CXNN;
         case 0xD:
             // DRW Vx, Vy, nibble
-            op_DXYN(instruction);
-            break;
+            return OP_DXYN;
         case 0xE:
             switch (kk) {
                 case 0x9E:
                     // SKP Vx
-                    op_EX9E(instruction);
-                    break;
+                    return OP_EX9E;
                 case 0xA1:
                     // SKNP Vx
-                    op_EXA1(instruction);
-                    break;
+                    return OP_EXA1;
             }
-            break;
+            return OP_NOP;
         case 0xF:
             switch (kk) {
                 case 0x07:
                     // LD Vx, DT
-                    op_FX07(instruction);
-                    break;
+                    return OP_FX07;
                 case 0x0A:
                     // LD Vx, K
-                    op_FX0A(instruction);
-                    break;
+                    return OP_FX0A;
                 case 0x15:
                     // LD DT, Vx
-                    op_FX15(instruction);
-                    break;
+                    return OP_FX15;
                 case 0x18:
                     // LD ST, Vx
-                    op_FX18(instruction);
-                    break;
+                    return OP_FX18;
                 case 0x1E:
                     // ADD I, Vx
-                    op_FX1E(instruction);
-                    break;
+                    return OP_FX1E;
                 case 0x29:
                     // LD F, Vx
-                    op_FX29(instruction);
-                    break;
+                    return OP_FX29;
                 case 0x33:
                     // LD B, Vx
-                    op_FX33(instruction);
-                    break;
+                    return OP_FX33;
                 case 0x55:
                     // LD [I], Vx
-                    op_FX55(instruction);
-                    break;
+                    return OP_FX55;
                 case 0x65:
                     // LD Vx, [I]
-                    op_FX65(instruction);
-                    break;
+                    return OP_FX65;
             }
-            break;
-        default:
-            halt = true;
-            break;
+            return OP_NOP;
     }
+    return OP_HALT;
+}
+
+// Unknown instruction, stop the machine
+void Chip8::op_HALT(Operands)
+{
+    halt = true;
+}
+
+// Unknown instruction inside a known group, ignored
+void Chip8::op_NOP(Operands)
+{
 }
 
 // Clear screen
-void Chip8::op_00E0()
+void Chip8::op_00E0(Operands)
 {
     //std::cout << "op_00E0" << '\n';
-    for (unsigned int y=0; y < DISPLAY_HEIGHT; y++)
-    {
-        for (unsigned int x=0; x < DISPLAY_WIDTH; x++)
-        {   
-            video[x][y] = 0;
-        }
+    DirtyRegion cleared;
+    for (unsigned int y = 0; y < DISPLAY_HEIGHT; y++) {
+        cleared.rows |= uint32_t(video[y] != 0) << y;
+        cleared.columns |= video[y];
+        video[y] = 0;
     }
 
-    drawFlag = true;
+    dirty.add(cleared);
+    unpublished.add(cleared);
 }
 
 // Return from subroutine call
-void Chip8::op_00EE()
+void Chip8::op_00EE(Operands)
 {
     //std::cout << "op_00EE" << '\n';
-    if (!stack.empty()) {
-        pc = stack.top();
-        stack.pop();
-    } 
+    if (sp > 0) {
+        pc = stack[--sp];
+    }
 }
 
 // Jump to address NNN
-void Chip8::op_1NNN(uint16_t instruction)
+void Chip8::op_1NNN(Operands op)
 {
     //std::cout << "op_1NNN" << '\n';
-    uint16_t address = instruction & 0x0FFF;
-    pc = address;
+    pc = op.nnn;
 }
 
 // Skip the next instruction if register X equals value NN
-void Chip8::op_3XNN(uint16_t instruction) {
+void Chip8::op_3XNN(Operands op) {
     //std::cout << "op_3XNN" << '\n';
-    // Extract register index X from instruction
-    uint8_t X = (instruction >> 8) & 0x0F;
-    // Extract value NN from instruction
-    uint8_t NN = instruction & 0xFF;
     // Compare value in register X to value NN
-    if (V[X] == NN) {
+    if (V[op.x] == op.nn) {
         // If they are equal, skip the next instruction
         pc += 2;
     }
 }
 
 // Skip the next instruction if register X is not equal to value NN
-void Chip8::op_4XNN(uint16_t instruction) {
+void Chip8::op_4XNN(Operands op) {
     //std::cout << "op_4XNN" << '\n';
-    uint8_t X = (instruction >> 8) & 0x0F;
-    uint8_t RR = instruction & 0xFF;
-
-    if (V[X] != RR) {
+    if (V[op.x] != op.nn) {
         pc += 2;
     }
 }
 
 // Skip the next instruction if the value in register X equals the value in register Y
-void Chip8::op_5XY0(uint16_t instruction) {
+void Chip8::op_5XY0(Operands op) {
     //std::cout << "op_5XY0" << '\n';
-    uint8_t X = (instruction >> 8) & 0x0F;
-    // Extract register index Y from instruction
-    uint8_t Y = (instruction >> 4) & 0x0F;
-
-    if (V[X] == V[Y]) {
+    if (V[op.x] == V[op.y]) {
         pc += 2;
     }
 }
 
-void Chip8::op_8XY0(uint16_t instruction) {
+void Chip8::op_8XY0(Operands op) {
     //std::cout << "op_8XY0" << '\n';
-    uint8_t X = (instruction >> 8) & 0x0F;
-    uint8_t Y = (instruction >> 4) & 0x0F;
-    V[X] = V[Y];
+    V[op.x] = V[op.y];
 }
 
-void Chip8::op_8XY1(uint16_t instruction) {
+void Chip8::op_8XY1(Operands op) {
     //std::cout << "op_8XY1" << '\n';
-    uint8_t X = (instruction >> 8) & 0x0F;
-    uint8_t Y = (instruction >> 4) & 0x0F;
-    V[X] |= V[Y];
+    V[op.x] |= V[op.y];
 }
 
-void Chip8::op_8XY2(uint16_t instruction) {
+void Chip8::op_8XY2(Operands op) {
     //std::cout << "op_8XY2" << '\n';
-    uint8_t X = (instruction >> 8) & 0x0F;
-    uint8_t Y = (instruction >> 4) & 0x0F;
-    V[X] &= V[Y];
+    V[op.x] &= V[op.y];
 }
 
-void Chip8::op_8XY3(uint16_t instruction) {
+void Chip8::op_8XY3(Operands op) {
     //std::cout << "op_8XY3" << '\n';
-    uint8_t X = (instruction >> 8) & 0x0F;
-    uint8_t Y = (instruction >> 4) & 0x0F;
-    V[X] ^= V[Y];
+    V[op.x] ^= V[op.y];
 }
 
-void Chip8::op_8XY4(uint16_t instruction) {
+void Chip8::op_8XY4(Operands op) {
     //std::cout << "op_8XY4" << '\n';
-    uint8_t X = (instruction >> 8) & 0x0F;
-    uint8_t Y = (instruction >> 4) & 0x0F;
-    uint16_t sum = V[X] + V[Y];
-    V[X] = sum & 0xFF;
+    uint16_t sum = V[op.x] + V[op.y];
+    V[op.x] = sum & 0xFF;
     V[0xF] = (sum > 0xFF) ? 1 : 0;
 }
 
-void Chip8::op_8XY6(uint16_t instruction) {
+template <typename Quirks>
+void Chip8::op_8XY6(Operands op) {
     //std::cout << "op_8XY6" << '\n';
-    uint8_t X = (instruction >> 8) & 0x0F;
-    uint8_t Y = (shiftQuirk)? X : ((instruction >> 4) & 0x0F);
+    uint8_t Y = (Quirks::shiftQuirk)? op.x : op.y;
     uint8_t t = V[Y] & 0x1;
-    V[X] = V[Y] >> 1;
+    V[op.x] = V[Y] >> 1;
     V[0xF] = t;
 }
 
-void Chip8::op_8XY7(uint16_t instruction) {
+void Chip8::op_8XY7(Operands op) {
     //std::cout << "op_8XY7" << '\n';
-    uint8_t X = (instruction >> 8) & 0x0F;
-    uint8_t Y = (instruction >> 4) & 0x0F;
-    V[X] = V[Y] - V[X];
-    V[0xF] = (V[Y] > V[X]) ? 1 : 0;
+    V[op.x] = V[op.y] - V[op.x];
+    V[0xF] = (V[op.y] > V[op.x]) ? 1 : 0;
 }
 
-void Chip8::op_8XYE(uint16_t instruction) {
+template <typename Quirks>
+void Chip8::op_8XYE(Operands op) {
     //std::cout << "op_8X0E" << '\n';
-    uint8_t X = (instruction >> 8) & 0x0F;
-    uint8_t Y = (shiftQuirk)? X : ((instruction >> 4) & 0x0F);
+    uint8_t Y = (Quirks::shiftQuirk)? op.x : op.y;
     uint8_t t = V[Y] >> 7;
-    V[X] = V[Y] << 1;
+    V[op.x] = V[Y] << 1;
     V[0xF] = t;
 }
 
-void Chip8::op_9XY0(uint16_t instruction) {
+void Chip8::op_9XY0(Operands op) {
     //std::cout << "op_9XY0" << '\n';
-    uint8_t X = (instruction >> 8) & 0x0F;
-    uint8_t Y = (instruction >> 4) & 0x0F;
-    if (V[X] != V[Y]) {
+    if (V[op.x] != V[op.y]) {
         pc += 2;
     }
 }
 
-void Chip8::op_ANNN(uint16_t instruction) {
+void Chip8::op_ANNN(Operands op) {
     //std::cout << "op_ANNN" << '\n';
-    uint16_t address = instruction & 0x0FFF;
-    I = address; // 726
+    I = op.nnn; // 726
 }
 
-void Chip8::op_BNNN(uint16_t instruction) {
+void Chip8::op_BNNN(Operands op) {
     //std::cout << "op_BNNN" << '\n';
-    uint16_t address = instruction & 0x0FFF;
-    pc = address + V[0];
+    pc = op.nnn + V[0];
 }
 
-void Chip8::op_CXNN(uint16_t instruction) {
+void Chip8::op_CXNN(Operands op) {
     //std::cout << "op_CXNN" << '\n';
-    uint8_t X = (instruction >> 8) & 0x0F;
-    uint8_t byte = instruction & 0xFF;
-    uint8_t random_byte = rand() & 0xFF;
-    
-    V[X] = random_byte & byte;
-
+    V[op.x] = nextRandom(random) & op.nn;
 }
 
-void Chip8::op_DXYN(uint16_t instruction) {
+// One shift and XOR per sprite row, collisions are an AND test on the same row
+void Chip8::op_DXYN(Operands op) {
     //std::cout << "op_DXYN" << '\n';
-    uint16_t x = V[(instruction & 0x0F00u) >> 8u];
-    uint16_t y = V[(instruction & 0x00F0u) >> 4u];
-    uint16_t height = instruction & 0x000Fu;
-    uint16_t pixel;
-
-    V[0xF] = 0;
-    for (uint16_t yline = 0; yline < height; ++yline) {
-        pixel = memory[I + yline];
-        for (uint16_t xline = 0; xline < 8; ++xline) {
-            if ((pixel & (0x80u >> xline)) != 0) {
-                if (video[(x + xline) % 64][(y + yline) % 32] == 1) {
-                    V[0xF] = 1;
-                }
-                video[(x + xline) % 64][(y + yline) % 32] ^= 1;
-            }
-        }
+    unsigned int x = V[op.x];
+    unsigned int y = V[op.y];
+    uint64_t collision = 0;
+    DirtyRegion drawn;
+
+    for (unsigned int row = 0; row < op.n; row++) {
+        uint64_t sprite = spriteRow(memory[(I + row) & 0xFFF], x);
+        unsigned int line = (y + row) % DISPLAY_HEIGHT;
+        collision |= video[line] & sprite;
+        video[line] ^= sprite;
+        drawn.rows |= uint32_t(sprite != 0) << line;
+        drawn.columns |= sprite;
     }
 
-    drawFlag = true;
+    V[0xF] = (collision != 0) ? 1 : 0;
+    dirty.add(drawn);
+    unpublished.add(drawn);
 }
 
 
 // FX07: Set VX to the value of the delay timer
-void Chip8::op_FX07(uint16_t instruction) {
+void Chip8::op_FX07(Operands op) {
     //std::cout << "op_FX07" << '\n';
-    uint16_t x = (instruction & 0x0F00u) >> 8u;
-    V[x] = delayTimer;
+    V[op.x] = delayTimer;
 }
 
 // FX0A: A key press is awaited, and then stored in VX
-void Chip8::op_FX0A(uint16_t instruction) {
+void Chip8::op_FX0A(Operands op) {
     //std::cout << "op_FX0A" << '\n';
-    uint16_t x = (instruction & 0x0F00u) >> 8u;
-
     for (int i = 0; i < 16; ++i) {
         if (key[i] != 0) {
-            V[x] = i;
+            V[op.x] = i;
             return;
         }
     }
@@ -483,108 +1074,98 @@ void Chip8::op_FX0A(uint16_t instruction) {
 }
 
 // FX15: Set the delay timer to VX
-void Chip8::op_FX15(uint16_t instruction) {
+void Chip8::op_FX15(Operands op) {
     //std::cout << "op_FX15" << '\n';
-    unsigned short x = (instruction & 0x0F00u) >> 8u;
-    delayTimer = V[x];
+    delayTimer = V[op.x];
 }
 
 // FX18: Set the sound timer to VX
-void Chip8::op_FX18(uint16_t instruction) {
+void Chip8::op_FX18(Operands op) {
     //std::cout << "op_FX18" << '\n';
-    uint16_t x = (instruction & 0x0F00u) >> 8u;
-    soundTimer = V[x];
+    soundTimer = V[op.x];
 }
 
 // FX1E: Add VX to I
-void Chip8::op_FX1E(uint16_t instruction) {
+void Chip8::op_FX1E(Operands op) {
     //std::cout << "op_FX1E" << '\n';
-    uint16_t x = (instruction & 0x0F00u) >> 8u;
-    I += V[x];
+    I += V[op.x];
 }
 
 // FX29: Set I to the location of the sprite for the character in VX
-void Chip8::op_FX29(uint16_t instruction) {
+void Chip8::op_FX29(Operands op) {
     //std::cout << "op_FX29" << '\n';
-    uint16_t x = (instruction & 0x0F00u) >> 8u;
-    I = V[x] * 5;
+    I = V[op.x] * 5;
 }
 
 // FX33: Store the binary-coded decimal representation of VX at the addresses I, I+1, and I+2
-void Chip8::op_FX33(uint16_t instruction) {
+void Chip8::op_FX33(Operands op) {
     //std::cout << "op_FX33" << '\n';
-    uint16_t x = (instruction & 0x0F00u) >> 8u;
-    memory[I] = V[x] / 100;
-    memory[I + 1] = (V[x] / 10) % 10;
-    memory[I + 2] = V[x] % 10;
+    memory[I & 0xFFF] = V[op.x] / 100;
+    memory[(I + 1) & 0xFFF] = (V[op.x] / 10) % 10;
+    memory[(I + 2) & 0xFFF] = V[op.x] % 10;
+    invalidate(I, 3);
 }
 // FX55: Store V0 to VX (inclusive) in memory starting at address I
-void Chip8::op_FX55(uint16_t instruction) {
+template <typename Quirks>
+void Chip8::op_FX55(Operands op) {
     //std::cout << "op_FX55" << '\n';
-    uint16_t x = (instruction & 0x0F00u) >> 8u;
-    for (int i = 0; i <= x; ++i) {
-        memory[I + i] = V[i];
+    for (int i = 0; i <= op.x; ++i) {
+        memory[(I + i) & 0xFFF] = V[i];
     }
-    if (!loadStoreQuirk) I += x + 1;
+    invalidate(I, op.x + 1);
+    if (!Quirks::loadStoreQuirk) I += op.x + 1;
 }
 
 // FX65: Fill V0 to VX (inclusive) with values from memory starting at address I
-void Chip8::op_FX65(uint16_t instruction) {
+template <typename Quirks>
+void Chip8::op_FX65(Operands op) {
     //std::cout << "op_FX65" << '\n';
-    uint16_t x = (instruction & 0x0F00u) >> 8u;
-    for (int i = 0; i <= x; ++i) {
-        V[i] = memory[I + i];
+    for (int i = 0; i <= op.x; ++i) {
+        V[i] = memory[(I + i) & 0xFFF];
     }
-    if (!loadStoreQuirk) I += x + 1;
+    if (!Quirks::loadStoreQuirk) I += op.x + 1;
 }
 
-void Chip8::op_6XNN(uint16_t instruction) {
+void Chip8::op_6XNN(Operands op) {
     //std::cout << "op_6XNN" << '\n';
-    uint8_t x = (instruction >> 8) & 0x0F;
-    uint8_t nn = instruction & 0xFF;
-    V[x] = nn;
+    V[op.x] = op.nn;
 }
 
-void Chip8::op_7XNN(uint16_t instruction) {
+void Chip8::op_7XNN(Operands op) {
     //std::cout << "op_7XNN" << '\n';
-    uint8_t x = (instruction >> 8) & 0x0F;
-    uint8_t nn = instruction & 0xFF;
-    V[x] += nn;
+    V[op.x] += op.nn;
 }
 
-void Chip8::op_2NNN(uint16_t instruction) {
+void Chip8::op_2NNN(Operands op) {
     //std::cout << "op_2NNN" << '\n';
-    uint16_t address = instruction & 0x0FFF; // extract NNN  724
-    
-    // push current pc to the stack and update pc to address
-    stack.push(pc);
-    pc = address;
+    // push current pc to the stack and update pc to address. A call past
+    // STACK_SIZE levels halts instead of losing its return address.
+    if (sp >= STACK_SIZE) {
+        halt = true;
+        return;
+    }
+    stack[sp++] = pc;
+    pc = op.nnn;
 }
 
-void Chip8::op_EX9E(uint16_t instruction) {
+void Chip8::op_EX9E(Operands op) {
     //std::cout << "op_EK9E" << '\n';
-    uint8_t x = (instruction >> 8) & 0x0F; // extract X
-    
-    if (key[V[x]]) {
+    if (key[V[op.x] & 0xF]) {
         pc += 2;
     }
 }
 
-void Chip8::op_EXA1(uint16_t instruction) {
+void Chip8::op_EXA1(Operands op) {
     //std::cout << "op_EKA1" << '\n';
-    uint8_t x = (instruction >> 8) & 0x0F; // extract X
-    
-    if (!key[V[x]]) {
+    if (!key[V[op.x] & 0xF]) {
         pc += 2;
     }
 }
 
-void Chip8::op_8XY5(uint16_t instruction) {
+void Chip8::op_8XY5(Operands op) {
     //std::cout << "op_8XY5" << '\n';
-    uint8_t x = (instruction >> 8) & 0x0F; // extract X
-    uint8_t y = (instruction >> 4) & 0x0F; // extract Y
-    uint8_t t = (V[x] >= V[y])? 1 : 0;
-    V[x] -= V[y];
+    uint8_t t = (V[op.x] >= V[op.y])? 1 : 0;
+    V[op.x] -= V[op.y];
     V[0xF] = t;
 }
 
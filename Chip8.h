@@ -1,7 +1,7 @@
 #pragma once
 
-#include <stack>
 #include <cstdint>
+#include <cstring>
 #include <string>
 #include <iostream>
 #include <fstream>
@@ -12,12 +12,57 @@
 #include <thread>
 #include <cstdlib>
 #include <ctime>
+#include <cmath>
+#include <cerrno>
+#include <algorithm>
+#include <memory>
+#include <bit>
+#include <atomic>
+#include <functional>
+#include <type_traits>
+#include <array>
+#include <random>
+#include "Jit.h"
 
 
 const unsigned int FONTSET_SIZE { 80 };
 const unsigned int MEMORY_SIZE { 4096 };
 const unsigned int REGISTERS_SIZE { 16 };
+const unsigned int STACK_SIZE { 16 };
 const unsigned int DISPLAY_WIDTH { 64 }, DISPLAY_HEIGHT { 32 };
+const uint16_t STATE_VERSION { 2 };
+// Save state layout, all multi-byte values in host byte order. Chip8's
+// saveState/loadState, Chip8Lockstep::saveState and chip8-diff all use these.
+const size_t STATE_VERSION_AT { 4 };                        // after "C8ST", u16
+const size_t STATE_FLAGS_AT { 6 };                          // u8 STATE_*_FLAG, then a pad byte
+const size_t STATE_MEMORY_AT { 8 };
+const size_t STATE_V_AT { STATE_MEMORY_AT + MEMORY_SIZE };
+const size_t STATE_I_AT { STATE_V_AT + REGISTERS_SIZE };    // u16
+const size_t STATE_PC_AT { STATE_I_AT + 2 };                // u16
+const size_t STATE_SP_AT { STATE_PC_AT + 2 };               // u16
+const size_t STATE_STACK_AT { STATE_SP_AT + 2 };            // u16[STACK_SIZE]
+const size_t STATE_DELAY_AT { STATE_STACK_AT + 2 * STACK_SIZE };
+const size_t STATE_SOUND_AT { STATE_DELAY_AT + 1 };
+const size_t STATE_KEY_AT { STATE_SOUND_AT + 1 };           // u8[16]
+const size_t STATE_VIDEO_AT { STATE_KEY_AT + 16 };          // u64[DISPLAY_HEIGHT]
+const size_t STATE_FRAME_CYCLE_AT { STATE_VIDEO_AT + 8 * DISPLAY_HEIGHT };  // u32
+const size_t STATE_CYCLES_AT { STATE_FRAME_CYCLE_AT + 4 };  // u64
+const size_t STATE_FRAMES_AT { STATE_CYCLES_AT + 8 };       // u64
+const size_t STATE_RANDOM_AT { STATE_FRAMES_AT + 8 };       // u64
+const size_t STATE_SIZE { STATE_RANDOM_AT + 8 };
+const uint8_t STATE_SHIFT_QUIRK_FLAG { 1 }, STATE_LOAD_STORE_QUIRK_FLAG { 2 }, STATE_HALT_FLAG { 4 };
+// Granularity of copy-on-write memory in forks
+const unsigned int MEMORY_PAGE_SIZE { 256 };
+const unsigned int MEMORY_PAGES { MEMORY_SIZE / MEMORY_PAGE_SIZE };
+const uint32_t NO_PAGE { UINT32_MAX };
+const unsigned int MAX_BLOCK_LENGTH { 32 };
+// Longest loop body, in instructions, that idle detection looks at
+const unsigned int MAX_IDLE_LOOP { 8 };
+// Instructions per 60 Hz frame, matches Main's default speed
+const unsigned int DEFAULT_CYCLES_PER_FRAME { 280 };
+const double FRAME_PERIOD_MS { 1000.0 / 60.0 };
+// Frames the real-time scheduler may fall behind before it drops the backlog
+const unsigned int MAX_FRAMES_BEHIND { 6 };
 const uint8_t fontset[FONTSET_SIZE] =
         {
             0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
@@ -38,74 +83,486 @@ const uint8_t fontset[FONTSET_SIZE] =
             0xF0, 0x80, 0xF0, 0x80, 0x80  // F
         };
 
+// FNV-1a, used to identify ROMs
+inline uint64_t hashBytes(const uint8_t* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Seed for CXNN's generator. splitmix64 spreads nearby seeds apart and
+// never leaves xorshift with the all-zero state it can't leave.
+inline uint64_t randomState(uint64_t seed)
+{
+    uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    return z ? z : 1;
+}
+
+// xorshift64*, the top byte of the product is the random byte
+inline uint8_t nextRandom(uint64_t& state)
+{
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return (state * 0x2545F4914F6CDD1Dull) >> 56;
+}
+
+// The keys to hold each frame: a random key, sometimes none, for 1 to
+// longestHold frames at a time; with chords a second key sometimes joins in.
+// Depends only on the seed so every run plays the same.
+inline std::vector<uint16_t> randomKeyScript(uint32_t frames, uint64_t seed, uint32_t longestHold = 60,
+                                             bool chords = false)
+{
+    std::vector<uint16_t> script(frames);
+    uint64_t random = randomState(~seed);
+    uint16_t keys = 0;
+    uint32_t held = 0;
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        if (held == 0) {
+            uint8_t roll = nextRandom(random);
+            keys = (roll & 3) ? 1 << (roll >> 4) : 0;
+            if (chords && keys && (roll & 0xC) == 0) keys |= 1 << (nextRandom(random) & 0xF);
+            held = 1 + nextRandom(random) % longestHold;
+        }
+        held--;
+        script[frame] = keys;
+    }
+    return script;
+}
+
+// Copy a field, scalar or array, to or from a save state at a STATE_*_AT offset
+template <typename T>
+inline void putState(uint8_t* buffer, size_t at, const T& value)
+{
+    std::memcpy(buffer + at, &value, sizeof(T));
+}
+
+template <typename T>
+inline void getState(const uint8_t* buffer, size_t at, T& value)
+{
+    std::memcpy(&value, buffer + at, sizeof(T));
+}
+
+// "C8ST", STATE_VERSION and the flags byte that open every save state
+inline void putStateHeader(uint8_t* buffer, uint8_t flags)
+{
+    std::memcpy(buffer, "C8ST", 4);
+    putState(buffer, STATE_VERSION_AT, STATE_VERSION);
+    buffer[STATE_FLAGS_AT] = flags;
+    buffer[STATE_FLAGS_AT + 1] = 0;
+}
+
+// Sprite byte as it lands in a packed display row at column x, wrapping at the right edge
+inline uint64_t spriteRow(uint8_t bits, unsigned int x)
+{
+    return std::rotr(uint64_t(bits) << 56, x % DISPLAY_WIDTH);
+}
+
+bool readROM(std::string romName, std::vector<uint8_t>& bytes);
+
+// Operands pre-decoded from an instruction so handlers don't re-extract them
+struct Operands
+{
+    uint8_t x;
+    uint8_t y;
+    uint8_t n;
+    uint8_t nn;
+    uint16_t nnn;
+};
+
+// Handler indices stored in the dispatch table
+enum OpIndex : uint8_t
+{
+    OP_UNDECODED,
+    OP_HALT,
+    OP_NOP,
+    OP_00E0, OP_00EE,
+    OP_1NNN, OP_2NNN, OP_3XNN, OP_4XNN, OP_5XY0, OP_6XNN, OP_7XNN,
+    OP_8XY0, OP_8XY1, OP_8XY2, OP_8XY3, OP_8XY4, OP_8XY5, OP_8XY6, OP_8XY7, OP_8XYE,
+    OP_9XY0, OP_ANNN, OP_BNNN, OP_CXNN, OP_DXYN,
+    OP_EX9E, OP_EXA1,
+    OP_FX07, OP_FX0A, OP_FX15, OP_FX18, OP_FX1E, OP_FX29, OP_FX33, OP_FX55, OP_FX65,
+    OP_COUNT
+};
+
+// Decoded form of an instruction, cached per address
+struct Instruction
+{
+    Operands operands;
+    uint8_t op;
+};
+
+// Quirk profiles. Execution paths are instantiated per profile so the
+// handlers test these at compile time instead of on every instruction.
+struct CosmacVip
+{
+    static constexpr bool shiftQuirk = false;
+    static constexpr bool loadStoreQuirk = false;
+    static constexpr bool profiling = false;
+};
+
+struct SuperChip
+{
+    static constexpr bool shiftQuirk = true;
+    static constexpr bool loadStoreQuirk = true;
+    static constexpr bool profiling = false;
+};
+
+// A quirk profile with the profiling counters compiled in, see setProfiling
+template <typename Quirks>
+struct Profiled : Quirks
+{
+    static constexpr bool profiling = true;
+};
+
+const unsigned int DRAW_HISTOGRAM_BUCKETS { 8 };
+
+// Counters kept by the profiled execution paths, one increment per event
+struct Chip8Profile
+{
+    uint64_t opcodes[OP_COUNT] = {0};
+    // Executions of the instruction at each address
+    uint64_t addresses[MEMORY_SIZE] = {0};
+    // Backward jumps and skips taken from each address, and where the last one landed
+    uint64_t backEdges[MEMORY_SIZE] = {0};
+    uint16_t backTargets[MEMORY_SIZE] = {0};
+    // Calls by stack depth after the push, calls that found the stack full
+    uint64_t callDepths[STACK_SIZE + 1] = {0};
+    uint64_t stackOverflows = 0;
+    // DXYN work: sprites drawn, rows, and lit sprite pixels XORed in
+    uint64_t sprites = 0;
+    uint64_t spriteRows = 0;
+    uint64_t spritePixels = 0;
+    // Frames, and for frames that drew, where in the frame the last draw ran
+    uint64_t frames = 0;
+    uint64_t drawingFrames = 0;
+    uint64_t lastDrawCycles = 0;
+    uint64_t lastDrawHistogram[DRAW_HISTOGRAM_BUCKETS] = {0};
+    // Instructions into the current frame, and the one its last draw was
+    unsigned int frameInstructions = 0;
+    unsigned int lastDraw = 0;
+    bool drew = false;
+};
+
+// How well startCycle kept to its 60 Hz deadlines
+struct SchedulerStats
+{
+    uint64_t frames = 0;
+    uint64_t resyncs = 0;
+    // Lateness absorbed by sleeping to absolute deadlines instead of relative periods
+    double driftCorrectedMs = 0;
+    double maxLateMs = 0;
+};
+
+// Display rows and columns that changed, in the packed row layout
+struct DirtyRegion
+{
+    uint32_t rows = 0;
+    uint64_t columns = 0;
+
+    bool empty() const { return rows == 0; }
+    void add(const DirtyRegion& other) { rows |= other.rows; columns |= other.columns; }
+};
+
+// A completed display frame. sequence counts published frames, so a consumer
+// can tell a new frame from one it has already drawn. dirty is relative to
+// the previous sequence and only usable by a consumer that saw that one.
+struct Frame
+{
+    uint64_t rows[DISPLAY_HEIGHT] = {0};
+    uint64_t sequence = 0;
+    DirtyRegion dirty;
+};
+
+// Lock-free single producer, single consumer triple buffer. The producer
+// fills its back buffer and swaps it into the middle slot; the consumer
+// swaps the middle slot out only when it holds something newer. Neither
+// side ever waits on the other.
+class FrameBuffer
+{
+    public:
+        void publish(const uint64_t* rows, DirtyRegion dirty)
+        {
+            Frame& frame = frames[back];
+            std::copy(rows, rows + DISPLAY_HEIGHT, frame.rows);
+            frame.sequence = ++published;
+            frame.dirty = dirty;
+            back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX;
+        }
+
+        // Newest published frame. Stays valid until the next call.
+        const Frame& latest()
+        {
+            if (middle.load(std::memory_order_relaxed) & FRESH) {
+                front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+            }
+            return frames[front];
+        }
+
+    private:
+        static constexpr uint8_t INDEX = 0x3;
+        static constexpr uint8_t FRESH = 0x4;
+
+        Frame frames[3];
+        std::atomic<uint8_t> middle { 1 };
+        uint8_t back = 0;
+        uint8_t front = 2;
+        uint64_t published = 0;
+};
+
+// Immutable memory pages shared by forked states. A page lives until clear(),
+// so states only hold page indices and stay trivially copyable. Not thread
+// safe, give each searching thread its own store.
+class Chip8PageStore
+{
+    public:
+        Chip8PageStore() { clear(); }
+
+        uint32_t add(const uint8_t* data)
+        {
+            pages.emplace_back();
+            std::copy(data, data + MEMORY_PAGE_SIZE, pages.back().data());
+            return pages.size() - 1;
+        }
+        const uint8_t* page(uint32_t index) const { return pages[index].data(); }
+        size_t size() const { return pages.size(); }
+        size_t bytes() const { return pages.size() * MEMORY_PAGE_SIZE; }
+        // Unique per store and per clear, machines use it to tell whether their page indices still hold
+        uint64_t id() const { return storeId; }
+
+        // Drop every page, states forked into this store are invalid afterwards
+        void clear()
+        {
+            static std::atomic<uint64_t> nextId { 1 };
+            pages.clear();
+            storeId = nextId.fetch_add(1, std::memory_order_relaxed);
+        }
+
+    private:
+        std::vector<std::array<uint8_t, MEMORY_PAGE_SIZE>> pages;
+        uint64_t storeId;
+};
+
+// Everything a running machine needs, with memory as pages of a
+// Chip8PageStore. Plain data, a copy is a memcpy of a few hundred bytes.
+struct Chip8State
+{
+    uint32_t pages[MEMORY_PAGES];
+    uint64_t video[DISPLAY_HEIGHT];
+    uint64_t cycleCount;
+    uint64_t frameCount;
+    uint64_t random;
+    uint32_t frameCycle;
+    uint16_t stack[STACK_SIZE];
+    uint16_t I, pc, sp;
+    uint8_t V[REGISTERS_SIZE];
+    uint8_t key[16];
+    uint8_t delayTimer, soundTimer;
+    // STATE_*_FLAG bits, as in saveState
+    uint8_t flags;
+};
+static_assert(std::is_trivially_copyable_v<Chip8State>);
+
+struct RecompiledProgram;
+typedef unsigned int (*RecompiledBlock)(Chip8& chip);
+
 class Chip8
 {
     public:
-        unsigned int video[DISPLAY_WIDTH][DISPLAY_HEIGHT] {0};
-        bool drawFlag;
         bool halt;
         bool shiftQuirk, loadStoreQuirk;
         unsigned char key[16] = {0x00};
-        uint8_t soundTimer;
+        unsigned int cyclesPerFrame;
+        uint64_t cycleCount;
+        uint64_t frameCount;
+        SchedulerStats schedulerStats;
+        // Fast-forward over busy-wait loops, counted in idleCycles as if they ran
+        bool idleSkipping;
+        uint64_t idleCycles;
+        // Attach the recompiled program linked in for the loaded ROM and quirk, if any
+        bool useRecompiled;
+        // Called on the CPU thread before each startCycle frame, return false to skip the frame
+        std::function<bool(Chip8&)> frameHook;
 
         Chip8();
 
-        void loadROM(std::string romName);
+        bool loadROM(std::string romName);
+        void loadBytes(const uint8_t* data, size_t size);
+        bool attachProgram(const RecompiledProgram& program);
         void startCycle(float period);
+        uint64_t runCycles(uint64_t n);
+        uint64_t runFrames(uint32_t n);
         void setQuirks(bool value);
+        bool setJit(bool enabled);
+        // Count every instruction into a Chip8Profile. Swaps in profiled
+        // execution paths, which skip the JIT, AOT blocks and idle fast-forward,
+        // so a machine with profiling off runs exactly the code it did before.
+        // Enabling it detaches any recompiled program, and none attaches while on.
+        void setProfiling(bool enabled);
+        // Counters since profiling was enabled, null when it's off
+        const Chip8Profile* profile() const { return profileCounters.get(); }
+        // Restart CXNN's sequence, the same seed and inputs give the same run
+        void seed(uint64_t value) { random = randomState(value); }
+        // All 16 keys as a bitmask, bit i for key i
+        void setKeys(uint16_t mask) { for (unsigned int i = 0; i < 16; i++) key[i] = mask >> i & 1; }
+        uint16_t keyMask() const;
+        // FNV-1a hash and size of the last loaded program
+        uint64_t programHash() const { return romHash; }
+        uint32_t programSize() const { return romSize; }
+
+        // Snapshot the whole machine into buffer, returns the bytes written or
+        // 0 when size is below STATE_SIZE
+        size_t saveState(uint8_t* buffer, size_t size) const;
+        // Restore a snapshot from saveState, false if it isn't one of this version
+        bool loadState(const uint8_t* buffer, size_t size);
+
+        // Capture the machine as a Chip8State. Only pages written since the last
+        // fork into the same store are added to it, the rest are shared.
+        Chip8State fork(Chip8PageStore& store);
+        // Continue from a forked state, copying only the pages that differ
+        void restore(const Chip8State& state, const Chip8PageStore& store);
+
+        // Display as DISPLAY_HEIGHT packed rows, pixel x of a row at bit 63 - x.
+        // Only safe on the thread running the core, other threads use latestFrame.
+        const uint64_t* framebuffer() const { return video; }
+        // Newest frame published at a 60 Hz tick, safe from one other thread
+        const Frame& latestFrame() { return frames.latest(); }
+        // Display changes since the last clearDirty, for consumers on the core's thread
+        DirtyRegion dirtyRegion() const { return dirty; }
+        void clearDirty() { dirty = DirtyRegion(); }
+        // 60 Hz ticks so far with the sound timer running, safe from any thread
+        uint64_t soundTicks() const { return soundTickCount.load(std::memory_order_acquire); }
+        bool pixel(unsigned int x, unsigned int y) const { return video[y % DISPLAY_HEIGHT] >> (63 - x % DISPLAY_WIDTH) & 1; }
+        uint8_t peek(unsigned int address) const { return memory[address % MEMORY_SIZE]; }
 
     private:
+        friend class Chip8Jit;
+        friend struct Chip8Runtime;
+        friend class Chip8Lockstep;
+
         uint8_t memory[MEMORY_SIZE] = {0};
+        uint64_t video[DISPLAY_HEIGHT] = {0};
+        // Display changes since clearDirty and since the last published frame
+        DirtyRegion dirty;
+        DirtyRegion unpublished;
+        FrameBuffer frames;
         uint8_t V[REGISTERS_SIZE]  = {0};
         uint16_t I;
         uint8_t delayTimer;
+        uint8_t soundTimer;
+        std::atomic<uint64_t> soundTickCount { 0 };
+        // CXNN generator state, per machine so instances never share a sequence
+        uint64_t random;
         
         uint16_t pc;
         uint16_t sp;
+        // Instructions executed since the last timer tick
+        unsigned int frameCycle;
 
-        std::stack<uint16_t> stack;
+        // Return addresses, a call with a full stack halts the machine
+        uint16_t stack[STACK_SIZE] = {0};
 
-        
-        void DecrementDelay(auto delayStart, auto delayDuration);
+        // Store page each memory page matches, NO_PAGE once written, in the store with id pageStoreId
+        uint32_t pageIds[MEMORY_PAGES];
+        uint64_t pageStoreId;
+
+        // Handler index for every possible 16-bit instruction, built once
+        static uint8_t dispatchTable[0x10000];
 
+        // Decoded instruction starting at each address, OP_UNDECODED when stale
+        Instruction decoded[MEMORY_SIZE] = {};
+        // Instructions in the basic block starting at each address, 0 when not built
+        uint8_t blockLength[MEMORY_SIZE] = {0};
+        // Instructions in the idle loop body starting at each address, 0 for none, IDLE_UNKNOWN when not scanned
+        static constexpr uint8_t IDLE_UNKNOWN = 0xFF;
+        uint8_t idleLength[MEMORY_SIZE];
+
+        static bool buildDispatchTable();
+        static uint8_t decode(uint16_t instruction);
+        static Instruction decodeInstruction(uint16_t instruction);
+        static bool endsBlock(uint8_t op);
+        Instruction& fetch(uint16_t address);
+        uint8_t buildBlock(uint16_t address);
+        uint8_t scanIdleLoop(uint16_t address);
+        static bool idleSafe(uint8_t op);
+        void invalidate(uint16_t address, uint16_t length);
+        void findProgram();
+        void detachProgram();
+        void updateMemory(unsigned int address, const uint8_t* data, unsigned int length);
+
+        uint64_t romHash;
+        uint32_t romSize;
+        // Ahead-of-time compiled blocks by start address, null when none attached
+        std::unique_ptr<RecompiledBlock[]> staticBlocks;
+
+        std::unique_ptr<Chip8Jit> jit;
+        std::unique_ptr<Chip8Profile> profileCounters;
+        static uint32_t jitExecute(Chip8* chip, uint32_t argument);
+
+        void tickTimers();
+        void endFrame();
+        void publishFrame();
         void executeNextInstruction();
-        void executeInstruction(uint16_t instruction);
+        unsigned int executeNextBlock();
+
+        // Execution paths specialized for the current quirk profile, picked by setQuirks
+        void (Chip8::*instructionRunner)();
+        unsigned int (Chip8::*blockRunner)();
+        void (Chip8::*instructionExecutor)(Instruction instruction);
+
+        template <typename Quirks> void runInstruction();
+        template <typename Quirks> unsigned int runBlock();
+        template <typename Quirks> void executeInstruction(Instruction instruction);
+        template <typename Quirks> void useProfile();
+        void usePaths(bool quirks);
+        void profileInstruction(const Instruction& instruction, uint16_t address);
+        void profileControl(uint8_t op, uint16_t address);
+        void profileFrame();
         
-        void op_00E0();
-        void op_00EE();
-        void op_1NNN(uint16_t instruction);
-        void op_2NNN(uint16_t instruction);
-        void op_3XNN(uint16_t instruction);
-        void op_4XNN(uint16_t instruction);
-        void op_5XY0(uint16_t instruction);
-        void op_6XNN(uint16_t instruction);
-        void op_7XNN(uint16_t instruction);
-        void op_8XY0(uint16_t instruction);
-        void op_8XY1(uint16_t instruction);
-        void op_8XY2(uint16_t instruction);
-        void op_8XY3(uint16_t instruction);
-        void op_8XY4(uint16_t instruction);
-        void op_8XY5(uint16_t instruction);
-        void op_8XY6(uint16_t instruction);
-        void op_8XY7(uint16_t instruction);
-        void op_8XYE(uint16_t instruction);
-        void op_9XY0(uint16_t instruction);
-
-        void op_ANNN(uint16_t instruction);
-        void op_BNNN(uint16_t instruction);
-        void op_CXNN(uint16_t instruction);
-        void op_DXYN(uint16_t instruction);
-
-        void op_EX9E(uint16_t instruction);
-        void op_EXA1(uint16_t instruction);
-
-        void op_FX07(uint16_t instruction);
-        void op_FX0A(uint16_t instruction);
-        void op_FX15(uint16_t instruction);
-        void op_FX18(uint16_t instruction);
-        void op_FX1E(uint16_t instruction);
-        void op_FX29(uint16_t instruction);
-        void op_FX33(uint16_t instruction);
-        void op_FX55(uint16_t instruction);
-        void op_FX65(uint16_t instruction);
+        void op_HALT(Operands op);
+        void op_NOP(Operands op);
+        void op_00E0(Operands op);
+        void op_00EE(Operands op);
+        void op_1NNN(Operands op);
+        void op_2NNN(Operands op);
+        void op_3XNN(Operands op);
+        void op_4XNN(Operands op);
+        void op_5XY0(Operands op);
+        void op_6XNN(Operands op);
+        void op_7XNN(Operands op);
+        void op_8XY0(Operands op);
+        void op_8XY1(Operands op);
+        void op_8XY2(Operands op);
+        void op_8XY3(Operands op);
+        void op_8XY4(Operands op);
+        void op_8XY5(Operands op);
+        template <typename Quirks> void op_8XY6(Operands op);
+        void op_8XY7(Operands op);
+        template <typename Quirks> void op_8XYE(Operands op);
+        void op_9XY0(Operands op);
+
+        void op_ANNN(Operands op);
+        void op_BNNN(Operands op);
+        void op_CXNN(Operands op);
+        void op_DXYN(Operands op);
+
+        void op_EX9E(Operands op);
+        void op_EXA1(Operands op);
+
+        void op_FX07(Operands op);
+        void op_FX0A(Operands op);
+        void op_FX15(Operands op);
+        void op_FX18(Operands op);
+        void op_FX1E(Operands op);
+        void op_FX29(Operands op);
+        void op_FX33(Operands op);
+        template <typename Quirks> void op_FX55(Operands op);
+        template <typename Quirks> void op_FX65(Operands op);
 };
\ No newline at end of file
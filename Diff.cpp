@@ -0,0 +1,436 @@
+#include "Chip8.h"
+#include "Lockstep.h"
+#include "Recompiled.h"
+#include <filesystem>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+// chip8-diff: differential testing of the execution engines. A reference
+// Chip8 runs the plain interpreter one instruction at a time, without JIT,
+// recompiled blocks or idle fast-forward, next to a candidate engine fed the
+// same ROM, CXNN seed, quirk profile and random key presses. Their states
+// are compared after every frame, or every instruction with --step
+// instruction, and the first difference is reported field by field. A frame
+// that diverges is replayed from its start with growing instruction budgets
+// to find the instruction it diverged at. Engines only run a block when the
+// budget covers all of it, so for them that is the last instruction of the
+// block that went wrong; the trace printed with it shows the block.
+// --step instruction gives the candidate a budget of one too, which never
+// fits a block, so it only checks the engines' single instruction path.
+//
+//     chip8-diff [--engine block|aot|jit|profiled|lockstep|all] [--frames N]
+//                [--seeds N] [--seed N] [--threads N] [--step frame|instruction]
+//                [--filter text]
+//
+// Every ROM in roms/ is run --seeds times per engine, run i with seed
+// --seed + i, which also picks the quirk profile and the keys; rerun one with
+// --filter rom --engine name --seed value --seeds 1. Runs are spread over
+// --threads workers. Exits non-zero when any run diverged.
+//
+//   block     interpreter with blocks and idle fast-forward, the default core
+//   aot       as loaded, with its recompiled program when one is linked in
+//   jit       native blocks from Chip8Jit
+//   profiled  the setProfiling execution paths, enabled before loading
+//   lockstep  Chip8Lockstep lanes, each with its own seed and keys, frames only
+
+const unsigned int DIFF_LOCKSTEP_LANES { 8 };
+// Reference instructions shown up to the one that diverged
+const unsigned int DIFF_TRACE { 8 };
+
+typedef std::array<uint8_t, STATE_SIZE> StateBuffer;
+
+struct DiffJob
+{
+    std::string rom;
+    std::string engine;
+    uint64_t seed;
+};
+
+struct DiffResult
+{
+    bool skipped = false;
+    bool diverged = false;
+    uint64_t instructions = 0;
+    std::string report;
+};
+
+struct DiffConfig
+{
+    uint32_t frames = 1200;
+    bool instructionStep = false;
+};
+
+static std::string hex(uint64_t value, int width)
+{
+    std::ostringstream text;
+    text << "0x" << std::uppercase << std::hex << std::setw(width) << std::setfill('0') << value;
+    return text.str();
+}
+
+template <typename T>
+static T field(const StateBuffer& state, size_t at)
+{
+    T value;
+    getState(state.data(), at, value);
+    return value;
+}
+
+// One line per field that differs, the reference value first
+static std::vector<std::string> differences(const StateBuffer& reference, const StateBuffer& candidate)
+{
+    std::vector<std::string> lines;
+    auto compare = [&](const std::string& name, uint64_t a, uint64_t b, int width) {
+        if (a == b) return;
+        std::ostringstream line;
+        line << std::left << std::setw(14) << name << std::setw(20) << hex(a, width) << hex(b, width);
+        lines.push_back(line.str());
+    };
+
+    uint8_t flags = field<uint8_t>(reference, STATE_FLAGS_AT), otherFlags = field<uint8_t>(candidate, STATE_FLAGS_AT);
+    const uint8_t quirks = STATE_SHIFT_QUIRK_FLAG | STATE_LOAD_STORE_QUIRK_FLAG;
+    compare("halt", bool(flags & STATE_HALT_FLAG), bool(otherFlags & STATE_HALT_FLAG), 1);
+    compare("quirks", flags & quirks, otherFlags & quirks, 1);
+    for (unsigned int i = 0; i < REGISTERS_SIZE; i++) {
+        compare("V" + hex(i, 1).substr(2), reference[STATE_V_AT + i], candidate[STATE_V_AT + i], 2);
+    }
+    compare("I", field<uint16_t>(reference, STATE_I_AT), field<uint16_t>(candidate, STATE_I_AT), 3);
+    compare("pc", field<uint16_t>(reference, STATE_PC_AT), field<uint16_t>(candidate, STATE_PC_AT), 3);
+    uint16_t sp = field<uint16_t>(reference, STATE_SP_AT);
+    compare("sp", sp, field<uint16_t>(candidate, STATE_SP_AT), 1);
+    for (unsigned int i = 0; i < std::min<unsigned int>(sp, STACK_SIZE); i++) {
+        compare("stack[" + std::to_string(i) + "]", field<uint16_t>(reference, STATE_STACK_AT + 2 * i),
+                field<uint16_t>(candidate, STATE_STACK_AT + 2 * i), 3);
+    }
+    compare("delay timer", reference[STATE_DELAY_AT], candidate[STATE_DELAY_AT], 2);
+    compare("sound timer", reference[STATE_SOUND_AT], candidate[STATE_SOUND_AT], 2);
+    for (unsigned int i = 0; i < 16; i++) {
+        compare("key " + hex(i, 1).substr(2), reference[STATE_KEY_AT + i], candidate[STATE_KEY_AT + i], 1);
+    }
+
+    unsigned int bytes = 0;
+    for (unsigned int address = 0; address < MEMORY_SIZE; address++) {
+        if (reference[STATE_MEMORY_AT + address] == candidate[STATE_MEMORY_AT + address]) continue;
+        if (bytes++ < 4) compare("memory[" + hex(address, 3) + "]", reference[STATE_MEMORY_AT + address], candidate[STATE_MEMORY_AT + address], 2);
+    }
+    if (bytes > 4) lines.push_back("memory        " + std::to_string(bytes - 4) + " more bytes differ");
+
+    unsigned int rows = 0;
+    for (unsigned int y = 0; y < DISPLAY_HEIGHT; y++) {
+        if (field<uint64_t>(reference, STATE_VIDEO_AT + 8 * y) != field<uint64_t>(candidate, STATE_VIDEO_AT + 8 * y)) rows++;
+    }
+    if (rows) {
+        compare("display hash", hashBytes(reference.data() + STATE_VIDEO_AT, 8 * DISPLAY_HEIGHT),
+                hashBytes(candidate.data() + STATE_VIDEO_AT, 8 * DISPLAY_HEIGHT), 16);
+        lines.push_back("display       " + std::to_string(rows) + " rows differ");
+    }
+    compare("random", field<uint64_t>(reference, STATE_RANDOM_AT), field<uint64_t>(candidate, STATE_RANDOM_AT), 16);
+    compare("frame cycle", field<uint32_t>(reference, STATE_FRAME_CYCLE_AT), field<uint32_t>(candidate, STATE_FRAME_CYCLE_AT), 4);
+    compare("cycle count", field<uint64_t>(reference, STATE_CYCLES_AT), field<uint64_t>(candidate, STATE_CYCLES_AT), 8);
+    compare("frame count", field<uint64_t>(reference, STATE_FRAMES_AT), field<uint64_t>(candidate, STATE_FRAMES_AT), 8);
+    return lines;
+}
+
+// The reference: one instruction per call, never a block or a skip
+static void stepReference(Chip8& chip)
+{
+    chip.runCycles(1);
+}
+
+static void frameReference(Chip8& chip)
+{
+    uint64_t frame = chip.frameCount;
+    while (chip.frameCount == frame && !chip.halt) stepReference(chip);
+}
+
+static std::unique_ptr<Chip8> makeChip(const std::string& engine, bool quirks, uint64_t seed,
+                                       const std::vector<uint8_t>& bytes)
+{
+    auto chip = std::make_unique<Chip8>();
+    chip->seed(seed);
+    chip->setQuirks(quirks);
+    if (engine == "reference" || engine == "profiled") chip->idleSkipping = false;
+    if (engine == "jit") chip->setJit(true);
+    if (engine == "profiled") chip->setProfiling(true);
+    // Only the aot engine runs a recompiled program, the rest test their own path
+    chip->useRecompiled = engine == "aot";
+    chip->loadBytes(bytes.data(), bytes.size());
+    return chip;
+}
+
+static std::string header(const DiffJob& job, bool quirks)
+{
+    return "DIVERGED  " + job.rom + "  " + job.engine + "  seed " + std::to_string(job.seed) + "  quirks " + (quirks ? "on" : "off");
+}
+
+typedef std::vector<std::pair<uint16_t, uint16_t>> Trace;
+
+// Address and word of the instruction the reference is about to run
+static void record(const Chip8& reference, const StateBuffer& state, Trace& trace)
+{
+    uint16_t pc = field<uint16_t>(state, STATE_PC_AT);
+    trace.push_back({ pc, uint16_t(reference.peek(pc) << 8 | reference.peek(pc + 1)) });
+}
+
+static void reportInstruction(std::ostream& report, unsigned int k, const Trace& trace)
+{
+    report << "  instruction " << k << " of the frame, at " << hex(trace.back().first, 3) << ": "
+           << hex(trace.back().second, 4).substr(2) << '\n';
+    report << "  trace:";
+    for (size_t i = trace.size() > DIFF_TRACE ? trace.size() - DIFF_TRACE : 0; i < trace.size(); i++) {
+        report << " " << hex(trace[i].first, 3).substr(2) << ":" << hex(trace[i].second, 4).substr(2);
+    }
+    report << '\n';
+}
+
+// Replay the frame from the checkpoints with budgets of 1, 2, ... instructions
+// on the candidate until its state differs from the reference's
+static void locate(Chip8& reference, Chip8& candidate, const StateBuffer& checkpoint,
+                   const StateBuffer& candidateCheckpoint, std::ostream& report)
+{
+    reference.loadState(checkpoint.data(), STATE_SIZE);
+    StateBuffer a, b;
+    Trace trace;
+    for (unsigned int k = 1; k <= reference.cyclesPerFrame; k++) {
+        reference.saveState(a.data(), STATE_SIZE);
+        record(reference, a, trace);
+        stepReference(reference);
+
+        candidate.loadState(candidateCheckpoint.data(), STATE_SIZE);
+        candidate.runCycles(k);
+        reference.saveState(a.data(), STATE_SIZE);
+        candidate.saveState(b.data(), STATE_SIZE);
+        if (a != b) {
+            reportInstruction(report, k, trace);
+            return;
+        }
+        if (reference.halt) break;
+    }
+    report << "  the replay matched, the divergence depends on how the frame was sliced" << '\n';
+}
+
+static DiffResult runChip(const DiffJob& job, const DiffConfig& config, const std::vector<uint8_t>& bytes)
+{
+    DiffResult result;
+    uint64_t random = randomState(job.seed);
+    bool quirks = nextRandom(random) & 1;
+
+    if (job.engine == "jit" && !Chip8Jit::supported()) {
+        result.skipped = true;
+        return result;
+    }
+    if (job.engine == "aot") {
+        const RecompiledProgram* program = findRecompiled(hashBytes(bytes.data(), bytes.size()), bytes.size(), quirks);
+        if (!program) {
+            result.skipped = true;
+            return result;
+        }
+    }
+
+    auto reference = makeChip("reference", quirks, job.seed, bytes);
+    auto candidate = makeChip(job.engine, quirks, job.seed, bytes);
+    std::vector<uint16_t> script = randomKeyScript(config.frames, job.seed, 30, true);
+    StateBuffer checkpoint, candidateCheckpoint, a, b;
+    std::ostringstream report;
+
+    for (uint32_t frame = 0; frame < config.frames && !reference->halt; frame++) {
+        reference->setKeys(script[frame]);
+        candidate->setKeys(script[frame]);
+        reference->saveState(checkpoint.data(), STATE_SIZE);
+        candidate->saveState(candidateCheckpoint.data(), STATE_SIZE);
+        uint64_t start = reference->cycleCount;
+
+        if (config.instructionStep) {
+            uint64_t current = reference->frameCount;
+            Trace trace;
+            for (unsigned int k = 1; reference->frameCount == current && !reference->halt; k++) {
+                reference->saveState(a.data(), STATE_SIZE);
+                record(*reference, a, trace);
+                stepReference(*reference);
+                candidate->runCycles(1);
+                reference->saveState(a.data(), STATE_SIZE);
+                candidate->saveState(b.data(), STATE_SIZE);
+                if (a != b) {
+                    report << header(job, quirks) << '\n';
+                    report << "  frame " << frame << '\n';
+                    reportInstruction(report, k, trace);
+                    break;
+                }
+            }
+        } else {
+            frameReference(*reference);
+            candidate->runFrames(1);
+            reference->saveState(a.data(), STATE_SIZE);
+            candidate->saveState(b.data(), STATE_SIZE);
+            if (a != b) {
+                report << header(job, quirks) << '\n';
+                report << "  frame " << frame << '\n';
+                locate(*reference, *candidate, checkpoint, candidateCheckpoint, report);
+                reference->saveState(a.data(), STATE_SIZE);
+                candidate->saveState(b.data(), STATE_SIZE);
+            }
+        }
+        result.instructions += reference->cycleCount - start;
+
+        if (a != b) {
+            report << "  " << std::left << std::setw(14) << "field" << std::setw(20) << "reference" << "candidate" << '\n';
+            for (const std::string& line : differences(a, b)) report << "  " << line << '\n';
+            result.diverged = true;
+            result.report = report.str();
+            return result;
+        }
+    }
+    return result;
+}
+
+static DiffResult runLockstep(const DiffJob& job, const DiffConfig& config, const std::vector<uint8_t>& bytes)
+{
+    DiffResult result;
+    uint64_t random = randomState(job.seed);
+    bool quirks = nextRandom(random) & 1;
+
+    auto lanes = std::make_unique<Chip8Lockstep>(DIFF_LOCKSTEP_LANES);
+    lanes->setQuirks(quirks);
+    lanes->loadBytes(bytes.data(), bytes.size());
+
+    std::vector<std::unique_ptr<Chip8>> references;
+    std::vector<std::vector<uint16_t>> scripts;
+    for (unsigned int lane = 0; lane < DIFF_LOCKSTEP_LANES; lane++) {
+        uint64_t laneSeed = job.seed * DIFF_LOCKSTEP_LANES + lane;
+        references.push_back(makeChip("reference", quirks, laneSeed, bytes));
+        lanes->seed(lane, laneSeed);
+        scripts.push_back(randomKeyScript(config.frames, laneSeed, 30, true));
+    }
+
+    StateBuffer a, b;
+    for (uint32_t frame = 0; frame < config.frames; frame++) {
+        for (unsigned int lane = 0; lane < DIFF_LOCKSTEP_LANES; lane++) {
+            uint16_t keys = scripts[lane][frame];
+            references[lane]->setKeys(keys);
+            for (unsigned int i = 0; i < 16; i++) lanes->setKey(lane, i, keys >> i & 1);
+
+            uint64_t start = references[lane]->cycleCount;
+            frameReference(*references[lane]);
+            result.instructions += references[lane]->cycleCount - start;
+        }
+        lanes->runFrames(1);
+
+        for (unsigned int lane = 0; lane < DIFF_LOCKSTEP_LANES; lane++) {
+            references[lane]->saveState(a.data(), STATE_SIZE);
+            lanes->saveState(lane, b.data(), STATE_SIZE);
+            std::vector<std::string> lines = differences(a, b);
+            if (lines.empty()) continue;
+
+            std::ostringstream report;
+            report << header(job, quirks) << '\n';
+            report << "  frame " << frame << ", lane " << lane << " (seed " << job.seed * DIFF_LOCKSTEP_LANES + lane
+                   << "), lockstep is only compared at frame boundaries" << '\n';
+            report << "  " << std::left << std::setw(14) << "field" << std::setw(20) << "reference" << "candidate" << '\n';
+            for (const std::string& line : lines) report << "  " << line << '\n';
+            result.diverged = true;
+            result.report = report.str();
+            return result;
+        }
+    }
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    DiffConfig config;
+    std::string engine = "all", filter;
+    unsigned int seeds = 4;
+    uint64_t baseSeed = 0;
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--engine" && i + 1 < argc) engine = argv[++i];
+        else if (arg == "--frames" && i + 1 < argc) config.frames = std::stoul(argv[++i]);
+        else if (arg == "--seeds" && i + 1 < argc) seeds = std::stoul(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc) baseSeed = std::stoull(argv[++i]);
+        else if (arg == "--threads" && i + 1 < argc) threads = std::max(1ul, std::stoul(argv[++i]));
+        else if (arg == "--step" && i + 1 < argc) config.instructionStep = std::string(argv[++i]) == "instruction";
+        else if (arg == "--filter" && i + 1 < argc) filter = argv[++i];
+        else {
+            std::cout << "usage: chip8-diff [--engine block|aot|jit|profiled|lockstep|all] [--frames N] [--seeds N]"
+                      << " [--seed N] [--threads N] [--step frame|instruction] [--filter text]" << '\n';
+            return 1;
+        }
+    }
+
+    std::vector<std::string> engines { "block", "aot", "jit", "profiled", "lockstep" };
+    if (engine != "all") {
+        if (std::find(engines.begin(), engines.end(), engine) == engines.end()) {
+            std::cout << "Unknown engine " << engine << '\n';
+            return 1;
+        }
+        engines = { engine };
+    }
+
+    std::vector<std::string> roms;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator("roms", error)) {
+        std::string name = entry.path().filename().string();
+        if (entry.is_regular_file() && name.find(filter) != std::string::npos) roms.push_back(name);
+    }
+    std::sort(roms.begin(), roms.end());
+
+    std::map<std::string, std::vector<uint8_t>> programs;
+    for (const std::string& rom : roms) {
+        if (!readROM(rom, programs[rom])) {
+            std::cout << "Error trying to open " << rom << '\n';
+            return 1;
+        }
+    }
+
+    std::vector<DiffJob> jobs;
+    for (const std::string& rom : roms) {
+        for (const std::string& name : engines) {
+            for (unsigned int i = 0; i < seeds; i++) jobs.push_back(DiffJob { rom, name, baseSeed + i });
+        }
+    }
+
+    std::vector<DiffResult> results(jobs.size());
+    std::atomic<size_t> next { 0 };
+    auto work = [&]() {
+        for (size_t i = next++; i < jobs.size(); i = next++) {
+            const DiffJob& job = jobs[i];
+            const std::vector<uint8_t>& bytes = programs.at(job.rom);
+            results[i] = (job.engine == "lockstep") ? runLockstep(job, config, bytes) : runChip(job, config, bytes);
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < std::min<size_t>(threads, jobs.size()); i++) workers.emplace_back(work);
+    work();
+    for (auto& worker : workers) worker.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t instructions = 0;
+    unsigned int diverged = 0;
+    std::map<std::string, std::array<unsigned int, 3>> counts;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        const DiffResult& result = results[i];
+        instructions += result.instructions;
+        auto& count = counts[jobs[i].engine];
+        count[0]++;
+        if (result.diverged) {
+            count[1]++;
+            diverged++;
+            std::cout << result.report << '\n';
+        }
+        if (result.skipped) count[2]++;
+    }
+
+    std::cout << "Engine      Runs  Diverged  Skipped" << '\n';
+    for (const std::string& name : engines) {
+        const auto& count = counts[name];
+        std::cout << std::left << std::setw(10) << name << std::right << std::setw(6) << count[0]
+                  << std::setw(10) << count[1] << std::setw(9) << count[2] << '\n';
+    }
+    std::cout << jobs.size() << " runs over " << roms.size() << " ROMs, " << config.frames << " frames each, "
+              << instructions << " reference instructions in " << seconds << " s on " << workers.size() + 1 << " threads" << '\n';
+    return diverged ? 1 : 0;
+}
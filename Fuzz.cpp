@@ -0,0 +1,236 @@
+#include "Chip8.h"
+#include "Profile.h"
+#include <filesystem>
+#include <csignal>
+
+// chip8-fuzz: feeds arbitrary programs and key streams to a headless core.
+// Built with clang and -fsanitize=fuzzer,address,undefined -DCHIP8_LIBFUZZER
+// it is a libFuzzer target; without CHIP8_LIBFUZZER it has its own driver
+// that replays inputs and mutates them at random, for compilers without
+// libFuzzer. Either way build it with ASan and UBSan so an out of bounds
+// access stops the run at the instruction that made it.
+//
+//     chip8-fuzz --make-corpus corpus          seed corpus from roms/
+//     chip8-fuzz corpus [more inputs...]       run every input once
+//     chip8-fuzz corpus --mutate N [--seed N]  N random mutations of the inputs
+//
+// Input layout: flags u8 (bit 0 quirks), frames u8, one key byte per frame
+// (bit 7 clear holds key bits 0-3, set holds none), then the program, loaded
+// at 0x200. Frames are kept short so a run costs microseconds; executed
+// addresses and opcode classes are counted across all runs and reported
+// at exit.
+
+const unsigned int FUZZ_MAX_FRAMES { 16 };
+const unsigned int FUZZ_CYCLES_PER_FRAME { 32 };
+const uint8_t FUZZ_NO_KEY { 0x80 };
+
+class FuzzTarget
+{
+    public:
+        FuzzTarget()
+        {
+            chip.seed(0);
+            chip.cyclesPerFrame = FUZZ_CYCLES_PER_FRAME;
+            chip.idleSkipping = false;
+            chip.setProfiling(true);
+            pristine = chip.fork(store);
+        }
+
+        void run(const uint8_t* data, size_t size)
+        {
+            if (size < 2) return;
+            bool quirks = data[0] & 1;
+            unsigned int frames = 1 + data[1] % FUZZ_MAX_FRAMES;
+            data += 2;
+            size -= 2;
+
+            const uint8_t* keys = data;
+            size_t keyCount = std::min<size_t>(frames, size);
+            data += keyCount;
+            size -= keyCount;
+
+            // Back to power-on, only the pages the last run wrote are copied
+            chip.restore(pristine, store);
+            chip.setQuirks(quirks);
+            chip.loadBytes(data, size);
+            for (unsigned int frame = 0; frame < frames && !chip.halt; frame++) {
+                uint8_t held = (frame < keyCount) ? keys[frame] : FUZZ_NO_KEY;
+                chip.setKeys((held & FUZZ_NO_KEY) ? 0 : 1 << (held & 0xF));
+                chip.runFrames(1);
+            }
+            executions++;
+        }
+
+        void report(std::ostream& out)
+        {
+            const Chip8Profile* profile = chip.profile();
+            unsigned int opcodes = 0, addresses = 0;
+            for (unsigned int op = OP_HALT; op < OP_COUNT; op++) {
+                if (profile->opcodes[op]) opcodes++;
+            }
+            for (uint64_t count : profile->addresses) {
+                if (count) addresses++;
+            }
+
+            out << "Executions   " << executions << '\n';
+            out << "Opcodes      " << opcodes << "/" << OP_COUNT - OP_HALT << " classes covered";
+            const char* separator = ", missing ";
+            for (unsigned int op = OP_HALT; op < OP_COUNT; op++) {
+                if (profile->opcodes[op]) continue;
+                out << separator << opcodeName(op);
+                separator = " ";
+            }
+            out << '\n';
+            out << "Addresses    " << addresses << "/" << MEMORY_SIZE << " executed at least once" << '\n';
+        }
+
+    private:
+        Chip8 chip;
+        Chip8PageStore store;
+        Chip8State pristine;
+        uint64_t executions = 0;
+};
+
+static FuzzTarget& target()
+{
+    static FuzzTarget fuzzTarget;
+    return fuzzTarget;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    target().run(data, size);
+    return 0;
+}
+
+#ifndef CHIP8_LIBFUZZER
+
+// The input being run, written out if a sanitizer stops the process
+static std::vector<uint8_t> current;
+static std::string crashPath = "crash-input";
+
+static void saveCurrent(int signal)
+{
+    std::ofstream out(crashPath, std::ios::binary);
+    out.write(reinterpret_cast<const char*>(current.data()), current.size());
+    out.close();
+    std::cout << "Input written to " << crashPath << std::endl;
+    std::signal(signal, SIG_DFL);
+    std::raise(signal);
+}
+
+// Have both sanitizers abort on their first report so saveCurrent sees it
+extern "C" const char* __asan_default_options() { return "abort_on_error=1"; }
+extern "C" const char* __ubsan_default_options() { return "abort_on_error=1:halt_on_error=1:print_stacktrace=1"; }
+
+static bool readFile(const std::filesystem::path& path, std::vector<uint8_t>& bytes)
+{
+    std::ifstream input(path, std::ios::binary);
+    if (input.fail()) return false;
+    bytes.assign((std::istreambuf_iterator<char>(input)), (std::istreambuf_iterator<char>()));
+    return true;
+}
+
+// One corpus entry per ROM: no quirks, every frame, no keys held
+static int makeCorpus(const std::string& directory)
+{
+    std::filesystem::create_directories(directory);
+    unsigned int written = 0;
+    for (const auto& entry : std::filesystem::directory_iterator("roms")) {
+        std::vector<uint8_t> rom;
+        if (!entry.is_regular_file() || !readFile(entry.path(), rom)) continue;
+
+        std::vector<uint8_t> input { 0, FUZZ_MAX_FRAMES - 1 };
+        input.insert(input.end(), FUZZ_MAX_FRAMES, FUZZ_NO_KEY);
+        input.insert(input.end(), rom.begin(), rom.end());
+
+        std::ofstream out(std::filesystem::path(directory) / entry.path().stem(), std::ios::binary);
+        out.write(reinterpret_cast<const char*>(input.data()), input.size());
+        written++;
+    }
+    std::cout << "Wrote " << written << " inputs to " << directory << '\n';
+    return written ? 0 : 1;
+}
+
+// Flip, overwrite, insert or erase a few bytes, favouring the header and key bytes
+static void mutate(std::vector<uint8_t>& input, uint64_t& random)
+{
+    unsigned int edits = 1 + nextRandom(random) % 8;
+    for (unsigned int i = 0; i < edits; i++) {
+        size_t at = input.empty() ? 0 : (nextRandom(random) << 8 | nextRandom(random)) % input.size();
+        if (nextRandom(random) < 32) at %= 2 + FUZZ_MAX_FRAMES;
+        switch (nextRandom(random) % 4) {
+            case 0:
+                if (!input.empty()) input[at] ^= 1 << (nextRandom(random) % 8);
+                break;
+            case 1:
+                if (!input.empty()) input[at] = nextRandom(random);
+                break;
+            case 2:
+                if (input.size() < MEMORY_SIZE) input.insert(input.begin() + at, uint8_t(nextRandom(random)));
+                break;
+            case 3:
+                if (!input.empty()) input.erase(input.begin() + at);
+                break;
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> paths;
+    uint64_t mutations = 0;
+    uint64_t seed = 0;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--make-corpus" && i + 1 < argc) return makeCorpus(argv[i + 1]);
+        else if (arg == "--mutate" && i + 1 < argc) mutations = std::stoull(argv[++i]);
+        else if (arg == "--seed" && i + 1 < argc) seed = std::stoull(argv[++i]);
+        else paths.push_back(arg);
+    }
+    if (paths.empty()) {
+        std::cout << "usage: chip8-fuzz --make-corpus dir | chip8-fuzz <inputs or dirs...> [--mutate N] [--seed N]" << '\n';
+        return 1;
+    }
+
+    std::signal(SIGABRT, saveCurrent);
+
+    std::vector<std::vector<uint8_t>> corpus;
+    for (const std::string& path : paths) {
+        std::vector<std::filesystem::path> files;
+        if (std::filesystem::is_directory(path)) {
+            for (const auto& entry : std::filesystem::directory_iterator(path)) files.push_back(entry.path());
+            std::sort(files.begin(), files.end());
+        } else {
+            files.push_back(path);
+        }
+        for (const auto& file : files) {
+            std::vector<uint8_t> bytes;
+            if (!readFile(file, bytes)) {
+                std::cout << "Error trying to open " << file.string() << '\n';
+                return 1;
+            }
+            corpus.push_back(bytes);
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (const auto& input : corpus) {
+        current = input;
+        target().run(current.data(), current.size());
+    }
+
+    uint64_t random = randomState(seed);
+    for (uint64_t i = 0; i < mutations && !corpus.empty(); i++) {
+        current = corpus[(nextRandom(random) << 8 | nextRandom(random)) % corpus.size()];
+        mutate(current, random);
+        target().run(current.data(), current.size());
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    target().report(std::cout);
+    std::cout << "Exec/s       " << (corpus.size() + mutations) / seconds << '\n';
+    return 0;
+}
+
+#endif
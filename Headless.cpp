@@ -0,0 +1,367 @@
+#include "Chip8.h"
+#include "Pool.h"
+#include "Lockstep.h"
+#include "Rewind.h"
+#include "Movie.h"
+#include "Profile.h"
+
+// chip8-headless: runs a ROM without a window or audio, as fast as the core
+// can go, and reports throughput. With --instances it runs that many copies
+// of the ROM on a Chip8Pool and reports aggregate throughput and frame latency.
+// With --lanes it runs that many copies in lockstep on Chip8Lockstep, lane i
+// holding key i % 16 down so the lanes diverge; --verify then replays every
+// lane on the scalar core and compares the final states. CXNN is seeded with
+// --seed, plus the instance or lane number, so every run is reproducible.
+//
+//     chip8-headless golf.ch8 [--frames N] [--cpf N] [--jit] [--quirks] [--seed N] [--no-idle] [--profile]
+//                             [--instances N] [--threads N] [--quantum N]
+//                             [--lanes N] [--verify] [--bench-state N] [--rewind]
+//                             [--bench-fork N] [--record movie.c8m] [--replay movie.c8m]
+//
+// --no-idle runs busy-wait loops instead of fast-forwarding over them.
+// --profile counts every instruction, which runs them all on the interpreter,
+// and prints a flat profile and the hot loops after the run.
+// --bench-state times N saveState and N loadState calls on the final state.
+// --bench-fork forks the final state N times, then runs N one-frame children
+// of it the way a tree search would, and reports forks per second.
+// --record plays the ROM with random key presses and saves the movie,
+// --replay runs a movie and checks it against its display hash chain.
+// --rewind captures every frame into a default Chip8Rewind, reports its
+// footprint and capture cost, then rewinds and checks the restored states.
+
+static int runPool(Chip8Pool& pool, std::string romName, uint32_t frames, uint32_t quantum)
+{
+    if (!pool.loadROM(romName)) return 1;
+
+    PoolStats stats = pool.run(frames, quantum);
+    double worstMean = 0;
+    for (const InstanceStats& instance : stats.instances) {
+        worstMean = std::max(worstMean, instance.meanFrameUs);
+    }
+
+    std::cout << "Instances    " << pool.size() << '\n';
+    std::cout << "Frames       " << stats.frames << '\n';
+    std::cout << "Instructions " << stats.instructions << '\n';
+    std::cout << "Seconds      " << stats.seconds << '\n';
+    std::cout << "Instr/s      " << stats.instructionsPerSecond << '\n';
+    std::cout << "Frames/s     " << stats.frames / stats.seconds << '\n';
+    std::cout << "Frame us     p50 " << stats.p50FrameUs << ", p99 " << stats.p99FrameUs
+              << ", max " << stats.maxFrameUs << ", worst instance mean " << worstMean << '\n';
+    return 0;
+}
+
+static int runLockstep(unsigned int lanes, std::string romName, uint32_t frames,
+                       unsigned int cyclesPerFrame, bool quirks, uint64_t seed, bool verify)
+{
+    std::vector<uint8_t> bytes;
+    if (!readROM(romName, bytes)) {
+        std::cout << "Error trying to open " << romName << '\n';
+        return 1;
+    }
+
+    auto machines = std::make_unique<Chip8Lockstep>(lanes);
+    machines->setQuirks(quirks);
+    machines->cyclesPerFrame = cyclesPerFrame;
+    machines->loadBytes(bytes.data(), bytes.size());
+    for (unsigned int lane = 0; lane < machines->lanes(); lane++) {
+        machines->setKey(lane, lane % 16, true);
+        machines->seed(lane, seed + lane);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t executed = machines->runFrames(frames);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const LockstepStats& stats = machines->stats;
+    std::cout << "Lanes        " << machines->lanes() << '\n';
+    std::cout << "Frames       " << machines->frameCount << '\n';
+    std::cout << "Instructions " << executed << " (" << stats.vectorInstructions << " vector, "
+              << stats.laneInstructions << " per lane)" << '\n';
+    std::cout << "Lanes/fetch  " << double(executed) / stats.groups << '\n';
+    std::cout << "Seconds      " << seconds << '\n';
+    std::cout << "Instr/s      " << executed / seconds << " (machines x instructions)" << '\n';
+
+    if (!verify) return 0;
+
+    unsigned int mismatches = 0;
+    for (unsigned int lane = 0; lane < machines->lanes(); lane++) {
+        auto chip = std::make_unique<Chip8>();
+        chip->setQuirks(quirks);
+        chip->cyclesPerFrame = cyclesPerFrame;
+        chip->loadBytes(bytes.data(), bytes.size());
+        chip->key[lane % 16] = 1;
+        chip->seed(seed + lane);
+        chip->runFrames(frames);
+        if (!machines->matches(lane, *chip)) {
+            std::cout << "Lane " << lane << " differs from the scalar core" << '\n';
+            mismatches++;
+        }
+    }
+    std::cout << "Verified     " << machines->lanes() - mismatches << "/" << machines->lanes() << " lanes" << '\n';
+    return mismatches ? 1 : 0;
+}
+
+static int benchmarkState(Chip8& chip, unsigned int iterations)
+{
+    static uint8_t checkpoint[STATE_SIZE];
+    static uint8_t scratch[STATE_SIZE];
+    chip.saveState(checkpoint, STATE_SIZE);
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; i++) {
+        chip.saveState(scratch, STATE_SIZE);
+    }
+    double saveNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+    // Diverge from the checkpoint between restores so every load has real work to undo
+    double loadNs = 0;
+    for (unsigned int i = 0; i < iterations; i++) {
+        chip.runCycles(64);
+        start = std::chrono::steady_clock::now();
+        chip.loadState(checkpoint, STATE_SIZE);
+        loadNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+    loadNs /= iterations;
+
+    chip.saveState(scratch, STATE_SIZE);
+    bool roundTrip = std::equal(checkpoint, checkpoint + STATE_SIZE, scratch);
+
+    std::cout << "State bytes  " << STATE_SIZE << '\n';
+    std::cout << "Save ns      " << saveNs << '\n';
+    std::cout << "Load ns      " << loadNs << " (after 64 instructions of divergence)" << '\n';
+    std::cout << "Round trip   " << (roundTrip ? "identical" : "DIFFERENT") << '\n';
+    return roundTrip ? 0 : 1;
+}
+
+static int benchmarkRewind(Chip8& chip, uint32_t frames)
+{
+    // The last few hundred states in full, to check what rewinding restores
+    const unsigned int checked = 600;
+    std::vector<std::array<uint8_t, STATE_SIZE>> history(checked);
+
+    Chip8Rewind rewind;
+    uint64_t instructions = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < frames && !chip.halt; i++) {
+        rewind.capture(chip);
+        chip.saveState(history[i % checked].data(), STATE_SIZE);
+        instructions += chip.runFrames(1);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    unsigned int held = rewind.frames();
+    unsigned int verified = 0, wrong = 0;
+    uint8_t state[STATE_SIZE];
+    for (unsigned int i = 0; i < std::min(held, checked); i++) {
+        rewind.rewind(chip);
+        chip.saveState(state, STATE_SIZE);
+        const auto& expected = history[(chip.frameCount) % checked];
+        if (std::equal(state, state + STATE_SIZE, expected.begin())) verified++;
+        else wrong++;
+    }
+
+    std::cout << "Instructions " << instructions << " in " << seconds << " s" << '\n';
+    std::cout << "Rewind       " << held << " frames (" << held / 60.0 << " s) in " << rewind.bytesUsed() / 1024.0
+              << " KB, arena " << rewind.arenaSize() / 1024 << " KB" << '\n';
+    std::cout << "Per frame    " << double(rewind.bytesUsed()) / held << " bytes, "
+              << rewind.averageCaptureNs() << " ns capture" << '\n';
+    std::cout << "Restored     " << verified << " exact, " << wrong << " wrong" << '\n';
+    return wrong ? 1 : 0;
+}
+
+static int benchmarkFork(Chip8& chip, unsigned int iterations)
+{
+    static uint8_t expected[STATE_SIZE];
+    static uint8_t restored[STATE_SIZE];
+    chip.saveState(expected, STATE_SIZE);
+
+    Chip8PageStore store;
+    Chip8State root = chip.fork(store);
+
+    // Nothing written in between, so every fork shares all of root's pages
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; i++) {
+        Chip8State state = chip.fork(store);
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        (void)state;
+    }
+    double forkNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+
+    // Expand root one frame per child, each child holding a different key
+    size_t rootPages = store.size();
+    uint64_t instructions = 0;
+    double restoreNs = 0;
+    start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < iterations; i++) {
+        auto restoreStart = std::chrono::steady_clock::now();
+        chip.restore(root, store);
+        restoreNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - restoreStart).count();
+        chip.key[i % 16] = 1;
+        instructions += chip.runFrames(1);
+        Chip8State child = chip.fork(store);
+        (void)child;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    chip.restore(root, store);
+    chip.saveState(restored, STATE_SIZE);
+    bool roundTrip = std::equal(expected, expected + STATE_SIZE, restored);
+
+    std::cout << "State bytes  " << sizeof(Chip8State) << " + " << MEMORY_PAGES << " shared pages of " << MEMORY_PAGE_SIZE << '\n';
+    std::cout << "Fork ns      " << forkNs << " (" << 1e9 / forkNs << " forks/s, no pages written)" << '\n';
+    std::cout << "Restore ns   " << restoreNs / iterations << " (back to the root after one frame)" << '\n';
+    std::cout << "Children/s   " << iterations / seconds << " (restore, one frame of " << double(instructions) / iterations
+              << " instructions, fork)" << '\n';
+    std::cout << "Pages        " << double(store.size() - rootPages) / iterations << " copied per child, "
+              << store.bytes() / 1024.0 << " KB in the store" << '\n';
+    std::cout << "Round trip   " << (roundTrip ? "identical" : "DIFFERENT") << '\n';
+    return roundTrip ? 0 : 1;
+}
+
+static int recordMovie(Chip8& chip, uint32_t frames, uint64_t seed, std::string path)
+{
+    Chip8Movie movie;
+    movie.start(chip, seed);
+
+    std::vector<uint16_t> script = randomKeyScript(frames, seed);
+    for (uint32_t frame = 0; frame < frames && !chip.halt; frame++) {
+        uint16_t keys = script[frame];
+        chip.setKeys(keys);
+        movie.record(chip, keys);
+        chip.runFrames(1);
+    }
+    movie.finish(chip);
+
+    if (!movie.save(path)) {
+        std::cout << "Error trying to write " << path << '\n';
+        return 1;
+    }
+    std::ifstream written(path, std::ios::binary | std::ios::ate);
+    std::cout << "Recorded     " << movie.frames() << " frames, " << movie.runs() << " key runs, "
+              << written.tellg() << " bytes" << '\n';
+    return 0;
+}
+
+static int replayMovie(Chip8& chip, std::string path)
+{
+    Chip8Movie movie;
+    if (!movie.load(path)) {
+        std::cout << "Error trying to read " << path << '\n';
+        return 1;
+    }
+
+    ReplayResult result = movie.replay(chip);
+    if (!result.loaded) {
+        std::cout << "The movie was recorded on a different ROM" << '\n';
+        return 1;
+    }
+
+    std::cout << "Frames       " << result.frames << " (" << result.frames / 3600.0 << " minutes)" << '\n';
+    std::cout << "Instructions " << result.instructions << '\n';
+    std::cout << "Seconds      " << result.seconds << " (" << result.seconds * 216000 / result.frames << " per hour of play)" << '\n';
+    if (result.matched) {
+        std::cout << "Display      matches the recording" << '\n';
+    } else {
+        std::cout << "Display      diverged in frames " << result.firstMismatch << "-"
+                  << result.firstMismatch + MOVIE_CHECKPOINT_INTERVAL - 1 << '\n';
+    }
+    return result.matched ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string romName;
+    uint32_t frames = 3600;
+    unsigned int cyclesPerFrame = DEFAULT_CYCLES_PER_FRAME;
+    bool useJit = false;
+    bool quirks = false;
+    uint64_t seed = 0;
+    bool idleSkipping = true;
+    bool profiling = false;
+    unsigned int instances = 0;
+    unsigned int threads = std::thread::hardware_concurrency();
+    uint32_t quantum = 1;
+    unsigned int lanes = 0;
+    bool verify = false;
+    unsigned int stateIterations = 0;
+    bool rewind = false;
+    unsigned int forkIterations = 0;
+    std::string recordPath, replayPath;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc) frames = std::stoul(argv[++i]);
+        else if (arg == "--cpf" && i + 1 < argc) cyclesPerFrame = std::stoul(argv[++i]);
+        else if (arg == "--jit") useJit = true;
+        else if (arg == "--quirks") quirks = true;
+        else if (arg == "--seed" && i + 1 < argc) seed = std::stoull(argv[++i]);
+        else if (arg == "--no-idle") idleSkipping = false;
+        else if (arg == "--profile") profiling = true;
+        else if (arg == "--instances" && i + 1 < argc) instances = std::stoul(argv[++i]);
+        else if (arg == "--threads" && i + 1 < argc) threads = std::stoul(argv[++i]);
+        else if (arg == "--quantum" && i + 1 < argc) quantum = std::stoul(argv[++i]);
+        else if (arg == "--lanes" && i + 1 < argc) lanes = std::stoul(argv[++i]);
+        else if (arg == "--verify") verify = true;
+        else if (arg == "--bench-state" && i + 1 < argc) stateIterations = std::stoul(argv[++i]);
+        else if (arg == "--rewind") rewind = true;
+        else if (arg == "--bench-fork" && i + 1 < argc) forkIterations = std::stoul(argv[++i]);
+        else if (arg == "--record" && i + 1 < argc) recordPath = argv[++i];
+        else if (arg == "--replay" && i + 1 < argc) replayPath = argv[++i];
+        else romName = arg;
+    }
+    if (romName.empty() || cyclesPerFrame == 0) {
+        std::cout << "usage: chip8-headless <rom.ch8> [--frames N] [--cpf N] [--jit] [--quirks] [--seed N] [--no-idle] [--profile]"
+                  << " [--instances N] [--threads N] [--quantum N] [--lanes N] [--verify]"
+                  << " [--bench-state N] [--rewind] [--bench-fork N]"
+                  << " [--record movie.c8m] [--replay movie.c8m]" << '\n';
+        return 1;
+    }
+
+    if (lanes > 0) return runLockstep(lanes, romName, frames, cyclesPerFrame, quirks, seed, verify);
+
+    if (instances > 0) {
+        Chip8Pool pool(threads);
+        for (unsigned int i = 0; i < instances; i++) {
+            Chip8& chip = pool.add();
+            chip.setQuirks(quirks);
+            chip.seed(seed + i);
+            chip.idleSkipping = idleSkipping;
+            if (useJit) chip.setJit(true);
+            chip.cyclesPerFrame = cyclesPerFrame;
+        }
+        return runPool(pool, romName, frames, quantum);
+    }
+
+    Chip8 chip;
+    chip.setQuirks(quirks);
+    chip.seed(seed);
+    chip.idleSkipping = idleSkipping;
+    if (useJit && !chip.setJit(true)) {
+        std::cout << "JIT not supported on this host, using the interpreter" << '\n';
+    }
+    chip.cyclesPerFrame = cyclesPerFrame;
+    chip.setProfiling(profiling);
+    if (!chip.loadROM(romName)) return 1;
+    if (rewind) return benchmarkRewind(chip, frames);
+    if (!recordPath.empty()) return recordMovie(chip, frames, seed, recordPath);
+    if (!replayPath.empty()) return replayMovie(chip, replayPath);
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t executed = chip.runFrames(frames);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Frames       " << chip.frameCount << (chip.halt ? " (halted)" : "") << '\n';
+    std::cout << "Instructions " << executed << '\n';
+    std::cout << "Seconds      " << seconds << '\n';
+    std::cout << "Instr/s      " << executed / seconds << '\n';
+    std::cout << "Idle         " << 100.0 * chip.idleCycles / std::max<uint64_t>(executed, 1) << "% fast-forwarded" << '\n';
+    std::cout << "Frames/s     " << chip.frameCount / seconds << " (" << chip.frameCount / seconds / 60.0 << "x real time)" << '\n';
+    if (profiling) {
+        std::cout << '\n';
+        printProfile(std::cout, chip);
+    }
+
+    if (stateIterations > 0) return benchmarkState(chip, stateIterations);
+    if (forkIterations > 0) return benchmarkFork(chip, forkIterations);
+    return 0;
+}
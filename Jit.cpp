@@ -0,0 +1,324 @@
+#include "Jit.h"
+#include "Chip8.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CHIP8_JIT_X64 1
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+Chip8Jit::Chip8Jit()
+{
+    used = 0;
+    cursor = nullptr;
+    arena = nullptr;
+
+    if (!supported()) return;
+
+#ifdef _WIN32
+    arena = static_cast<uint8_t*>(VirtualAlloc(nullptr, JIT_ARENA_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+#else
+    void* memory = mmap(nullptr, JIT_ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    arena = (memory == MAP_FAILED) ? nullptr : static_cast<uint8_t*>(memory);
+#endif
+}
+
+Chip8Jit::~Chip8Jit()
+{
+    if (!arena) return;
+
+#ifdef _WIN32
+    VirtualFree(arena, 0, MEM_RELEASE);
+#else
+    munmap(arena, JIT_ARENA_SIZE);
+#endif
+}
+
+bool Chip8Jit::supported()
+{
+#ifdef CHIP8_JIT_X64
+    return true;
+#else
+    return false;
+#endif
+}
+
+JitBlock Chip8Jit::blockAt(Chip8& chip, uint16_t address)
+{
+    if (blocks[address]) return blocks[address];
+    if (!arena || ++heat[address] < JIT_THRESHOLD) return nullptr;
+
+    heat[address] = 0;
+    blocks[address] = compile(chip, address);
+    return blocks[address];
+}
+
+// Forget blocks starting in [first, last), their code is reclaimed on the next flush
+void Chip8Jit::invalidate(unsigned int first, unsigned int last)
+{
+    for (unsigned int i = first; i < last; i++) {
+        blocks[i] = nullptr;
+        heat[i] = 0;
+    }
+}
+
+void Chip8Jit::flush()
+{
+    std::memset(blocks, 0, sizeof(blocks));
+    std::memset(heat, 0, sizeof(heat));
+    used = 0;
+}
+
+void Chip8Jit::setWritable(bool writable)
+{
+#ifdef _WIN32
+    DWORD previous;
+    VirtualProtect(arena, JIT_ARENA_SIZE, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &previous);
+    if (!writable) FlushInstructionCache(GetCurrentProcess(), arena, JIT_ARENA_SIZE);
+#else
+    mprotect(arena, JIT_ARENA_SIZE, writable ? (PROT_READ | PROT_WRITE) : (PROT_READ | PROT_EXEC));
+#endif
+}
+
+void Chip8Jit::emit(uint8_t byte)
+{
+    *cursor++ = byte;
+}
+
+void Chip8Jit::emit16(uint16_t value)
+{
+    std::memcpy(cursor, &value, 2);
+    cursor += 2;
+}
+
+void Chip8Jit::emit32(uint32_t value)
+{
+    std::memcpy(cursor, &value, 4);
+    cursor += 4;
+}
+
+void Chip8Jit::emit64(uint64_t value)
+{
+    std::memcpy(cursor, &value, 8);
+    cursor += 8;
+}
+
+// opcode with a [rbx + offset] operand, reg is the register or /digit field
+void Chip8Jit::emitMem(uint8_t opcode, uint8_t reg, int32_t offset)
+{
+    emit(opcode);
+    emit(0x80 | (reg << 3) | 3);
+    emit32(offset);
+}
+
+// call Chip8::jitExecute(chip, argument), result in eax
+void Chip8Jit::emitCall(uint32_t argument)
+{
+#ifdef _WIN32
+    emit(0x48); emit(0x89); emit(0xD9);         // mov rcx, rbx
+    emit(0xBA); emit32(argument);               // mov edx, argument
+#else
+    emit(0x48); emit(0x89); emit(0xDF);         // mov rdi, rbx
+    emit(0xBE); emit32(argument);               // mov esi, argument
+#endif
+    emit(0x48); emit(0xB8);                     // mov rax, jitExecute
+    emit64(reinterpret_cast<uint64_t>(&Chip8::jitExecute));
+    emit(0xFF); emit(0xD0);                     // call rax
+}
+
+// pc = at + 4 when the preceding compare was equal (or not equal), else at + 2
+void Chip8Jit::emitSkip(int32_t pcOffset, uint16_t at, bool skipIfEqual)
+{
+    emit(0x66); emit(0xB8); emit16(at + 2);     // mov ax, at + 2
+    emit(0x66); emit(0xB9); emit16(at + 4);     // mov cx, at + 4
+    emit(0x66); emit(0x0F); emit(skipIfEqual ? 0x44 : 0x45); emit(0xC1); // cmove/cmovne ax, cx
+    emit(0x66); emitMem(0x89, 0, pcOffset);     // mov [pc], ax
+}
+
+void Chip8Jit::emitEpilogue()
+{
+#ifdef _WIN32
+    emit(0x48); emit(0x83); emit(0xC4); emit(0x20); // add rsp, 32
+#endif
+    emit(0x5B);                                 // pop rbx
+    emit(0xC3);                                 // ret
+}
+
+JitBlock Chip8Jit::compile(Chip8& chip, uint16_t address)
+{
+#ifdef CHIP8_JIT_X64
+    unsigned int length = chip.blockLength[address];
+    if (length == 0) length = chip.buildBlock(address);
+
+    // Worst case is a helper call with its exit check per instruction
+    if (used + (length + 2) * 48 > JIT_ARENA_SIZE) flush();
+
+    const int32_t V = reinterpret_cast<uint8_t*>(chip.V) - reinterpret_cast<uint8_t*>(&chip);
+    const int32_t I = reinterpret_cast<uint8_t*>(&chip.I) - reinterpret_cast<uint8_t*>(&chip);
+    const int32_t PC = reinterpret_cast<uint8_t*>(&chip.pc) - reinterpret_cast<uint8_t*>(&chip);
+    const int32_t VF = V + 0xF;
+    const int32_t DT = reinterpret_cast<uint8_t*>(&chip.delayTimer) - reinterpret_cast<uint8_t*>(&chip);
+
+    setWritable(true);
+    uint8_t* entry = arena + used;
+    cursor = entry;
+
+    uint8_t* exits[MAX_BLOCK_LENGTH];
+    unsigned int exitCount = 0;
+    bool pcWritten = false;
+
+    emit(0x53);                                 // push rbx
+#ifdef _WIN32
+    emit(0x48); emit(0x83); emit(0xEC); emit(0x20); // sub rsp, 32
+    emit(0x48); emit(0x89); emit(0xCB);         // mov rbx, rcx
+#else
+    emit(0x48); emit(0x89); emit(0xFB);         // mov rbx, rdi
+#endif
+
+    for (unsigned int i = 0; i < length; i++) {
+        uint16_t at = address + 2 * i;
+        Instruction instruction = chip.fetch(at);
+        Operands op = instruction.operands;
+        const int32_t vx = V + op.x;
+        const int32_t vy = V + op.y;
+        const int32_t shifted = chip.shiftQuirk ? vx : vy;
+        pcWritten = false;
+
+        switch (instruction.op) {
+            case OP_NOP:
+                break;
+            case OP_6XNN:
+                emitMem(0xC6, 0, vx); emit(op.nn);      // mov byte [vx], nn
+                break;
+            case OP_7XNN:
+                emitMem(0x80, 0, vx); emit(op.nn);      // add byte [vx], nn
+                break;
+            case OP_8XY0:
+                emitMem(0x8A, 0, vy);                   // mov al, [vy]
+                emitMem(0x88, 0, vx);                   // mov [vx], al
+                break;
+            case OP_8XY1:
+                emitMem(0x8A, 0, vy);                   // mov al, [vy]
+                emitMem(0x08, 0, vx);                   // or [vx], al
+                break;
+            case OP_8XY2:
+                emitMem(0x8A, 0, vy);                   // mov al, [vy]
+                emitMem(0x20, 0, vx);                   // and [vx], al
+                break;
+            case OP_8XY3:
+                emitMem(0x8A, 0, vy);                   // mov al, [vy]
+                emitMem(0x30, 0, vx);                   // xor [vx], al
+                break;
+            case OP_8XY4:
+                emitMem(0x8A, 0, vx);                   // mov al, [vx]
+                emitMem(0x02, 0, vy);                   // add al, [vy]
+                emit(0x0F); emit(0x92); emit(0xC1);     // setc cl
+                emitMem(0x88, 0, vx);                   // mov [vx], al
+                emitMem(0x88, 1, VF);                   // mov [vf], cl
+                break;
+            case OP_8XY5:
+                emitMem(0x8A, 0, vx);                   // mov al, [vx]
+                emitMem(0x2A, 0, vy);                   // sub al, [vy]
+                emit(0x0F); emit(0x93); emit(0xC1);     // setnc cl
+                emitMem(0x88, 0, vx);                   // mov [vx], al
+                emitMem(0x88, 1, VF);                   // mov [vf], cl
+                break;
+            case OP_8XY6:
+                emitMem(0x8A, 0, shifted);              // mov al, [vy]
+                emit(0x88); emit(0xC1);                 // mov cl, al
+                emit(0x80); emit(0xE1); emit(0x01);     // and cl, 1
+                emit(0xD0); emit(0xE8);                 // shr al, 1
+                emitMem(0x88, 0, vx);                   // mov [vx], al
+                emitMem(0x88, 1, VF);                   // mov [vf], cl
+                break;
+            case OP_8XY7:
+                // VF compares against the updated VX, as op_8XY7 does
+                emitMem(0x8A, 0, vy);                   // mov al, [vy]
+                emitMem(0x2A, 0, vx);                   // sub al, [vx]
+                emitMem(0x88, 0, vx);                   // mov [vx], al
+                emitMem(0x8A, 1, vy);                   // mov cl, [vy]
+                emitMem(0x3A, 1, vx);                   // cmp cl, [vx]
+                emit(0x0F); emit(0x97); emit(0xC2);     // seta dl
+                emitMem(0x88, 2, VF);                   // mov [vf], dl
+                break;
+            case OP_8XYE:
+                emitMem(0x8A, 0, shifted);              // mov al, [vy]
+                emit(0x88); emit(0xC1);                 // mov cl, al
+                emit(0xC0); emit(0xE9); emit(0x07);     // shr cl, 7
+                emit(0xD0); emit(0xE0);                 // shl al, 1
+                emitMem(0x88, 0, vx);                   // mov [vx], al
+                emitMem(0x88, 1, VF);                   // mov [vf], cl
+                break;
+            case OP_ANNN:
+                emit(0x66); emitMem(0xC7, 0, I); emit16(op.nnn); // mov word [I], nnn
+                break;
+            case OP_FX1E:
+                emit(0x0F); emitMem(0xB6, 0, vx);       // movzx eax, byte [vx]
+                emit(0x66); emitMem(0x01, 0, I);        // add [I], ax
+                break;
+            case OP_FX07:
+                emitMem(0x8A, 0, DT);                   // mov al, [delayTimer]
+                emitMem(0x88, 0, vx);                   // mov [vx], al
+                break;
+            case OP_1NNN:
+                emit(0x66); emitMem(0xC7, 0, PC); emit16(op.nnn); // mov word [pc], nnn
+                pcWritten = true;
+                break;
+            case OP_3XNN:
+            case OP_4XNN:
+                emitMem(0x80, 7, vx); emit(op.nn);      // cmp byte [vx], nn
+                emitSkip(PC, at, instruction.op == OP_3XNN);
+                pcWritten = true;
+                break;
+            case OP_5XY0:
+            case OP_9XY0:
+                emitMem(0x8A, 0, vx);                   // mov al, [vx]
+                emitMem(0x3A, 0, vy);                   // cmp al, [vy]
+                emitSkip(PC, at, instruction.op == OP_5XY0);
+                pcWritten = true;
+                break;
+            case OP_FX29:
+                emit(0x0F); emitMem(0xB6, 0, vx);       // movzx eax, byte [vx]
+                emit(0x6B); emit(0xC0); emit(0x05);     // imul eax, eax, 5
+                emit(0x66); emitMem(0x89, 0, I);        // mov [I], ax
+                break;
+            default:
+                // Exit to the interpreter, which also sets pc
+                emitCall(at | (uint32_t(address) << 16));
+                pcWritten = true;
+                if (i + 1 < length) {
+                    emit(0x85); emit(0xC0);             // test eax, eax
+                    emit(0x74); emit(0x0A);             // je next
+                    emit(0xB8); emit32(i + 1);          // mov eax, executed
+                    emit(0xE9);                         // jmp epilogue
+                    exits[exitCount++] = cursor;
+                    emit32(0);
+                }
+                break;
+        }
+    }
+
+    if (!pcWritten) {
+        emit(0x66); emitMem(0xC7, 0, PC); emit16(address + 2 * length); // mov word [pc], end
+    }
+    emit(0xB8); emit32(length);                 // mov eax, length
+
+    for (unsigned int i = 0; i < exitCount; i++) {
+        int32_t relative = cursor - (exits[i] + 4);
+        std::memcpy(exits[i], &relative, 4);
+    }
+    emitEpilogue();
+
+    used = (cursor - arena + 15) & ~size_t(15);
+    setWritable(false);
+    return reinterpret_cast<JitBlock>(entry);
+#else
+    return nullptr;
+#endif
+}
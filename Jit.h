@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+class Chip8;
+
+// Native code for one basic block, returns the number of instructions executed
+typedef unsigned int (*JitBlock)(Chip8* chip);
+
+const unsigned int JIT_THRESHOLD { 16 };
+const size_t JIT_ARENA_SIZE { 1 << 20 };
+
+// x86-64 translator for hot basic blocks. ALU ops, I updates, jumps, skips
+// and delay timer reads are emitted inline against the Chip8 object;
+// everything else (DXYN, keys, timer writes, memory, calls) exits through
+// Chip8::jitExecute.
+class Chip8Jit
+{
+    public:
+        Chip8Jit();
+        ~Chip8Jit();
+
+        static bool supported();
+
+        // Native code for the block at address, compiled once it gets hot
+        JitBlock blockAt(Chip8& chip, uint16_t address);
+        void invalidate(unsigned int first, unsigned int last);
+        void flush();
+
+    private:
+        uint8_t* arena;
+        size_t used;
+        uint8_t* cursor;
+
+        JitBlock blocks[4096] = {nullptr};
+        uint8_t heat[4096] = {0};
+
+        JitBlock compile(Chip8& chip, uint16_t address);
+        void setWritable(bool writable);
+
+        void emit(uint8_t byte);
+        void emit16(uint16_t value);
+        void emit32(uint32_t value);
+        void emit64(uint64_t value);
+        void emitMem(uint8_t opcode, uint8_t reg, int32_t offset);
+        void emitCall(uint32_t argument);
+        void emitSkip(int32_t pcOffset, uint16_t at, bool skipIfEqual);
+        void emitEpilogue();
+};
@@ -0,0 +1,621 @@
+#include "Lockstep.h"
+
+// The vector kernel alone is compiled for AVX2 and runs only on CPUs that
+// have it, so the rest of the build keeps the baseline instruction set
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define LOCKSTEP_AVX2 __attribute__((target("avx2")))
+#endif
+
+Chip8Lockstep::Chip8Lockstep(unsigned int lanes)
+{
+    laneCount = std::clamp(lanes, 1u, LOCKSTEP_LANES);
+    active = (laneCount == 32) ? 0xFFFFFFFFu : (1u << laneCount) - 1;
+    written = 0;
+    shiftQuirk = false;
+    loadStoreQuirk = false;
+    cyclesPerFrame = DEFAULT_CYCLES_PER_FRAME;
+    cycleCount = 0;
+    frameCount = 0;
+    steps = 0;
+    frameStep = 0;
+#if defined(LOCKSTEP_AVX2)
+    vectorPath = __builtin_cpu_supports("avx2");
+#else
+    vectorPath = false;
+#endif
+
+    static const bool dispatchBuilt = Chip8::buildDispatchTable();
+    (void)dispatchBuilt;
+
+    memory.reset(new uint8_t[LOCKSTEP_LANES][MEMORY_SIZE]);
+    for (unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+        seed(lane, lane);
+    }
+    loadBytes(nullptr, 0);
+}
+
+bool Chip8Lockstep::loadROM(std::string romName)
+{
+    std::vector<uint8_t> bytes;
+    if (!readROM(romName, bytes)) {
+        std::cout << "Error trying to open " << romName << '\n';
+        return false;
+    }
+
+    loadBytes(bytes.data(), bytes.size());
+    return true;
+}
+
+// Load the same program into every lane at 0x200
+void Chip8Lockstep::loadBytes(const uint8_t* data, size_t size)
+{
+    std::fill(std::begin(image), std::end(image), 0);
+    std::copy(fontset, fontset + FONTSET_SIZE, image);
+    size = std::min<size_t>(size, MEMORY_SIZE - 512);
+    if (size > 0) std::copy(data, data + size, image + 512);
+
+    for (unsigned int address = 0; address + 1 < MEMORY_SIZE; address++) {
+        decoded[address] = Chip8::decodeInstruction((uint16_t(image[address]) << 8) | image[address + 1]);
+    }
+    for (unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++) {
+        std::copy(std::begin(image), std::end(image), memory[lane]);
+        pc[lane] = 512;
+    }
+    written = 0;
+}
+
+void Chip8Lockstep::setQuirks(bool value)
+{
+    shiftQuirk = value;
+    loadStoreQuirk = value;
+}
+
+void Chip8Lockstep::setKey(unsigned int lane, uint8_t index, bool pressed)
+{
+    if (lane < laneCount) key[lane][index & 0xF] = pressed;
+}
+
+void Chip8Lockstep::seed(unsigned int lane, uint64_t value)
+{
+    if (lane < laneCount) random[lane] = randomState(value);
+}
+
+bool Chip8Lockstep::pixel(unsigned int lane, unsigned int x, unsigned int y) const
+{
+    return video[lane][y % DISPLAY_HEIGHT] >> (63 - x % DISPLAY_WIDTH) & 1;
+}
+
+bool Chip8Lockstep::matches(unsigned int lane, const Chip8& chip) const
+{
+    if (lane >= laneCount || halted(lane) != chip.halt) return false;
+    if (pc[lane] != chip.pc || I[lane] != chip.I) return false;
+    if (delayTimer[lane] != chip.delayTimer || soundTimer[lane] != chip.soundTimer) return false;
+    if (random[lane] != chip.random) return false;
+    if (sp[lane] != chip.sp || !std::equal(stack[lane], stack[lane] + sp[lane], chip.stack)) return false;
+
+    for (unsigned int i = 0; i < REGISTERS_SIZE; i++) {
+        if (V[i][lane] != chip.V[i]) return false;
+    }
+    if (!std::equal(memory[lane], memory[lane] + MEMORY_SIZE, chip.memory)) return false;
+    return std::equal(video[lane], video[lane] + DISPLAY_HEIGHT, chip.video);
+}
+
+size_t Chip8Lockstep::saveState(unsigned int lane, uint8_t* buffer, size_t size) const
+{
+    if (lane >= laneCount || size < STATE_SIZE) return 0;
+
+    uint8_t registers[REGISTERS_SIZE];
+    for (unsigned int i = 0; i < REGISTERS_SIZE; i++) registers[i] = V[i][lane];
+    uint16_t stackPointer = sp[lane];
+    bool stopped = halted(lane);
+    uint32_t frameCycle = stopped ? stoppedFrameCycle[lane] : frameStep;
+    uint64_t cycles = stopped ? stoppedCycles[lane] : steps;
+    uint64_t frames = stopped ? stoppedFrames[lane] : frameCount;
+
+    putStateHeader(buffer, (shiftQuirk ? STATE_SHIFT_QUIRK_FLAG : 0) | (loadStoreQuirk ? STATE_LOAD_STORE_QUIRK_FLAG : 0)
+                           | (stopped ? STATE_HALT_FLAG : 0));
+    putState(buffer, STATE_MEMORY_AT, memory[lane]);
+    putState(buffer, STATE_V_AT, registers);
+    putState(buffer, STATE_I_AT, I[lane]);
+    putState(buffer, STATE_PC_AT, pc[lane]);
+    putState(buffer, STATE_SP_AT, stackPointer);
+    putState(buffer, STATE_STACK_AT, stack[lane]);
+    putState(buffer, STATE_DELAY_AT, delayTimer[lane]);
+    putState(buffer, STATE_SOUND_AT, soundTimer[lane]);
+    putState(buffer, STATE_KEY_AT, key[lane]);
+    putState(buffer, STATE_VIDEO_AT, video[lane]);
+    putState(buffer, STATE_FRAME_CYCLE_AT, frameCycle);
+    putState(buffer, STATE_CYCLES_AT, cycles);
+    putState(buffer, STATE_FRAMES_AT, frames);
+    putState(buffer, STATE_RANDOM_AT, random[lane]);
+    return STATE_SIZE;
+}
+
+// Same frame structure as Chip8::runFrames: cyclesPerFrame steps, then the
+// timers of every lane that ran the whole frame tick once
+uint64_t Chip8Lockstep::runFrames(uint32_t n)
+{
+    uint64_t executed = 0;
+    for (uint32_t frame = 0; frame < n && active; frame++) {
+        uint32_t ticking = 0;
+        for (unsigned int cycle = 0; cycle < cyclesPerFrame && active; cycle++) {
+            if (cycle + 1 == cyclesPerFrame) ticking = active;
+            executed += std::popcount(active);
+            step();
+        }
+        frameStep = 0;
+
+        for (uint32_t lanes = ticking; lanes; lanes &= lanes - 1) {
+            unsigned int lane = std::countr_zero(lanes);
+            if (delayTimer[lane] > 0) delayTimer[lane]--;
+            if (soundTimer[lane] > 0) soundTimer[lane]--;
+        }
+        if (ticking) frameCount++;
+    }
+    cycleCount += executed;
+    return executed;
+}
+
+// Execute one instruction on every active lane
+void Chip8Lockstep::step()
+{
+    uint32_t pending = active;
+    while (pending) {
+        unsigned int leader = std::countr_zero(pending);
+        uint16_t address = pc[leader];
+        if (address + 1u >= MEMORY_SIZE) {
+            stop(leader);
+            pending &= ~(1u << leader);
+            continue;
+        }
+
+        uint32_t group = lanesAt(address) & pending;
+        uint8_t high = memory[leader][address], low = memory[leader][address + 1];
+        // Lanes that rewrote their code may hold a different instruction here,
+        // and when the leader rewrote its own, so may every other lane
+        uint32_t check = (written >> leader & 1) ? group : group & written;
+        for (uint32_t lanes = check; lanes; lanes &= lanes - 1) {
+            unsigned int lane = std::countr_zero(lanes);
+            if (memory[lane][address] != high || memory[lane][address + 1] != low) group &= ~(1u << lane);
+        }
+        pending &= ~group;
+
+        Instruction instruction = (written >> leader & 1)
+            ? Chip8::decodeInstruction((uint16_t(high) << 8) | low)
+            : decoded[address];
+        executeGroup(instruction, group);
+        stats.groups++;
+    }
+    steps++;
+    frameStep++;
+}
+
+// Take a lane out of the active set. Chip8 counts the step that halts it,
+// whether a halt instruction or running off the end of memory.
+void Chip8Lockstep::stop(unsigned int lane)
+{
+    active &= ~(1u << lane);
+    uint32_t cycle = frameStep + 1;
+    stoppedCycles[lane] = steps + 1;
+    stoppedFrames[lane] = frameCount + (cycle == cyclesPerFrame);
+    stoppedFrameCycle[lane] = cycle % cyclesPerFrame;
+}
+
+#if defined(LOCKSTEP_AVX2)
+
+// 0xFF in byte i for every bit i set in bits
+LOCKSTEP_AVX2 static inline __m256i byteMask(uint32_t bits)
+{
+    const __m256i spread = _mm256_setr_epi8(
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+        2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+    const __m256i select = _mm256_set1_epi64x(0x8040201008040201ll);
+    __m256i bytes = _mm256_shuffle_epi8(_mm256_set1_epi32(bits), spread);
+    return _mm256_cmpeq_epi8(_mm256_and_si256(bytes, select), select);
+}
+
+// The same mask widened to 16-bit lanes, lanes 0-15 in low and 16-31 in high
+LOCKSTEP_AVX2 static inline void wordMask(uint32_t bits, __m256i& low, __m256i& high)
+{
+    __m256i mask = byteMask(bits);
+    low = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(mask));
+    high = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(mask, 1));
+}
+
+LOCKSTEP_AVX2 static inline uint32_t bitsOf(__m256i mask)
+{
+    return uint32_t(_mm256_movemask_epi8(mask));
+}
+
+LOCKSTEP_AVX2 static inline __m256i loadLanes(const uint8_t* lanes)
+{
+    return _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes));
+}
+
+LOCKSTEP_AVX2 static inline void storeLanes(uint8_t* lanes, __m256i value, __m256i mask)
+{
+    __m256i* row = reinterpret_cast<__m256i*>(lanes);
+    _mm256_store_si256(row, _mm256_blendv_epi8(_mm256_load_si256(row), value, mask));
+}
+
+// Add to the 16-bit lanes selected by bits
+LOCKSTEP_AVX2 static inline void addWords(uint16_t* lanes, __m256i low, __m256i high, uint32_t bits)
+{
+    __m256i lowMask, highMask;
+    wordMask(bits, lowMask, highMask);
+    __m256i* row = reinterpret_cast<__m256i*>(lanes);
+    _mm256_store_si256(row, _mm256_add_epi16(_mm256_load_si256(row), _mm256_and_si256(low, lowMask)));
+    _mm256_store_si256(row + 1, _mm256_add_epi16(_mm256_load_si256(row + 1), _mm256_and_si256(high, highMask)));
+}
+
+LOCKSTEP_AVX2 static inline void setWords(uint16_t* lanes, __m256i low, __m256i high, uint32_t bits)
+{
+    __m256i lowMask, highMask;
+    wordMask(bits, lowMask, highMask);
+    __m256i* row = reinterpret_cast<__m256i*>(lanes);
+    _mm256_store_si256(row, _mm256_blendv_epi8(_mm256_load_si256(row), low, lowMask));
+    _mm256_store_si256(row + 1, _mm256_blendv_epi8(_mm256_load_si256(row + 1), high, highMask));
+}
+
+LOCKSTEP_AVX2 uint32_t Chip8Lockstep::lanesAtVector(uint16_t address) const
+{
+    const __m256i* lanes = reinterpret_cast<const __m256i*>(pc);
+    __m256i target = _mm256_set1_epi16(address);
+    __m256i low = _mm256_cmpeq_epi16(_mm256_load_si256(lanes), target);
+    __m256i high = _mm256_cmpeq_epi16(_mm256_load_si256(lanes + 1), target);
+    // packs interleaves the 128-bit halves, put lanes back in order
+    return bitsOf(_mm256_permute4x64_epi64(_mm256_packs_epi16(low, high), 0xD8));
+}
+
+// Instructions that only touch V, I, pc and timers run on all lanes of the
+// group at once. Returns false for everything else.
+LOCKSTEP_AVX2 bool Chip8Lockstep::executeVector(Instruction instruction, uint32_t group)
+{
+    Operands op = instruction.operands;
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i two = _mm256_set1_epi16(2);
+    __m256i mask = byteMask(group);
+    uint8_t* X = V[op.x];
+    uint8_t* Y = V[op.y];
+    uint8_t* F = V[0xF];
+    uint8_t* S = shiftQuirk ? X : Y;
+    uint32_t skip = 0;
+
+    switch (instruction.op) {
+        case OP_NOP:
+        case OP_1NNN:
+        case OP_6XNN:
+        case OP_7XNN:
+        case OP_3XNN:
+        case OP_4XNN:
+        case OP_5XY0:
+        case OP_9XY0:
+        case OP_8XY0:
+        case OP_8XY1:
+        case OP_8XY2:
+        case OP_8XY3:
+        case OP_8XY4:
+        case OP_8XY5:
+        case OP_8XY6:
+        case OP_8XY7:
+        case OP_8XYE:
+        case OP_ANNN:
+        case OP_FX07:
+        case OP_FX15:
+        case OP_FX18:
+        case OP_FX1E:
+        case OP_FX29:
+            break;
+        default:
+            return false;
+    }
+
+    addWords(pc, two, two, group);
+
+    switch (instruction.op) {
+        case OP_1NNN:
+            setWords(pc, _mm256_set1_epi16(op.nnn), _mm256_set1_epi16(op.nnn), group);
+            break;
+        case OP_6XNN:
+            storeLanes(X, _mm256_set1_epi8(op.nn), mask);
+            break;
+        case OP_7XNN:
+            storeLanes(X, _mm256_add_epi8(loadLanes(X), _mm256_set1_epi8(op.nn)), mask);
+            break;
+        case OP_3XNN:
+            skip = bitsOf(_mm256_cmpeq_epi8(loadLanes(X), _mm256_set1_epi8(op.nn)));
+            break;
+        case OP_4XNN:
+            skip = ~bitsOf(_mm256_cmpeq_epi8(loadLanes(X), _mm256_set1_epi8(op.nn)));
+            break;
+        case OP_5XY0:
+            skip = bitsOf(_mm256_cmpeq_epi8(loadLanes(X), loadLanes(Y)));
+            break;
+        case OP_9XY0:
+            skip = ~bitsOf(_mm256_cmpeq_epi8(loadLanes(X), loadLanes(Y)));
+            break;
+        case OP_8XY0:
+            storeLanes(X, loadLanes(Y), mask);
+            break;
+        case OP_8XY1:
+            storeLanes(X, _mm256_or_si256(loadLanes(X), loadLanes(Y)), mask);
+            break;
+        case OP_8XY2:
+            storeLanes(X, _mm256_and_si256(loadLanes(X), loadLanes(Y)), mask);
+            break;
+        case OP_8XY3:
+            storeLanes(X, _mm256_xor_si256(loadLanes(X), loadLanes(Y)), mask);
+            break;
+        case OP_8XY4: {
+            __m256i x = loadLanes(X), y = loadLanes(Y);
+            __m256i sum = _mm256_add_epi8(x, y);
+            // Saturating and wrapping sums only differ on carry
+            __m256i carry = _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_adds_epu8(x, y), sum), one);
+            storeLanes(X, sum, mask);
+            storeLanes(F, carry, mask);
+            break;
+        }
+        case OP_8XY5: {
+            __m256i x = loadLanes(X), y = loadLanes(Y);
+            __m256i noBorrow = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(x, y), x), one);
+            storeLanes(X, _mm256_sub_epi8(x, y), mask);
+            storeLanes(F, noBorrow, mask);
+            break;
+        }
+        case OP_8XY6: {
+            __m256i s = loadLanes(S);
+            __m256i shifted = _mm256_and_si256(_mm256_srli_epi16(s, 1), _mm256_set1_epi8(0x7F));
+            storeLanes(X, shifted, mask);
+            storeLanes(F, _mm256_and_si256(s, one), mask);
+            break;
+        }
+        case OP_8XY7: {
+            storeLanes(X, _mm256_sub_epi8(loadLanes(Y), loadLanes(X)), mask);
+            // VF = VY > VX, compared after the store like the scalar handler
+            __m256i x = loadLanes(X), y = loadLanes(Y);
+            __m256i greater = _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_min_epu8(x, y), y), one);
+            storeLanes(F, greater, mask);
+            break;
+        }
+        case OP_8XYE: {
+            __m256i s = loadLanes(S);
+            __m256i carry = _mm256_and_si256(_mm256_srli_epi16(s, 7), one);
+            storeLanes(X, _mm256_add_epi8(s, s), mask);
+            storeLanes(F, carry, mask);
+            break;
+        }
+        case OP_ANNN:
+            setWords(I, _mm256_set1_epi16(op.nnn), _mm256_set1_epi16(op.nnn), group);
+            break;
+        case OP_FX07:
+            storeLanes(X, loadLanes(delayTimer), mask);
+            break;
+        case OP_FX15:
+            storeLanes(delayTimer, loadLanes(X), mask);
+            break;
+        case OP_FX18:
+            storeLanes(soundTimer, loadLanes(X), mask);
+            break;
+        case OP_FX1E:
+        case OP_FX29: {
+            __m256i x = loadLanes(X);
+            __m256i low = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(x));
+            __m256i high = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(x, 1));
+            if (instruction.op == OP_FX1E) {
+                addWords(I, low, high, group);
+            } else {
+                const __m256i five = _mm256_set1_epi16(5);
+                setWords(I, _mm256_mullo_epi16(low, five), _mm256_mullo_epi16(high, five), group);
+            }
+            break;
+        }
+    }
+
+    if (skip & group) addWords(pc, two, two, skip & group);
+    stats.vectorInstructions += std::popcount(group);
+    return true;
+}
+
+#else
+
+// Without AVX2 every instruction takes the per-lane path
+uint32_t Chip8Lockstep::lanesAtVector(uint16_t) const
+{
+    return 0;
+}
+
+bool Chip8Lockstep::executeVector(Instruction, uint32_t)
+{
+    return false;
+}
+
+#endif
+
+uint32_t Chip8Lockstep::lanesAt(uint16_t address) const
+{
+    if (vectorPath) return lanesAtVector(address);
+
+    uint32_t lanes = 0;
+    for (unsigned int lane = 0; lane < laneCount; lane++) {
+        lanes |= uint32_t(pc[lane] == address) << lane;
+    }
+    return lanes;
+}
+
+void Chip8Lockstep::executeGroup(Instruction instruction, uint32_t group)
+{
+    if (vectorPath && executeVector(instruction, group)) return;
+
+    for (uint32_t lanes = group; lanes; lanes &= lanes - 1) {
+        executeLane(std::countr_zero(lanes), instruction);
+    }
+    stats.laneInstructions += std::popcount(group);
+}
+
+// One instruction on one lane, mirroring the op_* handlers in Chip8.cpp.
+// Memory and key indices are masked so a lane can't reach its neighbours.
+void Chip8Lockstep::executeLane(unsigned int lane, Instruction instruction)
+{
+    Operands op = instruction.operands;
+    uint8_t& X = V[op.x][lane];
+    uint8_t& Y = V[op.y][lane];
+    uint8_t& F = V[0xF][lane];
+    uint8_t& S = shiftQuirk ? X : Y;
+    uint16_t& PC = pc[lane];
+    uint8_t* ram = memory[lane];
+    PC += 2;
+
+    switch (instruction.op) {
+        case OP_HALT:
+            stop(lane);
+            break;
+        case OP_NOP:
+            break;
+        case OP_00E0:
+            std::fill(std::begin(video[lane]), std::end(video[lane]), 0);
+            break;
+        case OP_00EE:
+            if (sp[lane] > 0) PC = stack[lane][--sp[lane]];
+            break;
+        case OP_1NNN:
+            PC = op.nnn;
+            break;
+        case OP_2NNN:
+            // A full stack halts the lane, as in Chip8
+            if (sp[lane] >= STACK_SIZE) {
+                stop(lane);
+                break;
+            }
+            stack[lane][sp[lane]++] = PC;
+            PC = op.nnn;
+            break;
+        case OP_3XNN:
+            if (X == op.nn) PC += 2;
+            break;
+        case OP_4XNN:
+            if (X != op.nn) PC += 2;
+            break;
+        case OP_5XY0:
+            if (X == Y) PC += 2;
+            break;
+        case OP_6XNN:
+            X = op.nn;
+            break;
+        case OP_7XNN:
+            X += op.nn;
+            break;
+        case OP_8XY0:
+            X = Y;
+            break;
+        case OP_8XY1:
+            X |= Y;
+            break;
+        case OP_8XY2:
+            X &= Y;
+            break;
+        case OP_8XY3:
+            X ^= Y;
+            break;
+        case OP_8XY4: {
+            uint16_t sum = X + Y;
+            X = sum & 0xFF;
+            F = (sum > 0xFF) ? 1 : 0;
+            break;
+        }
+        case OP_8XY5: {
+            uint8_t t = (X >= Y) ? 1 : 0;
+            X -= Y;
+            F = t;
+            break;
+        }
+        case OP_8XY6: {
+            uint8_t t = S & 0x1;
+            X = S >> 1;
+            F = t;
+            break;
+        }
+        case OP_8XY7:
+            X = Y - X;
+            F = (Y > X) ? 1 : 0;
+            break;
+        case OP_8XYE: {
+            uint8_t t = S >> 7;
+            X = S << 1;
+            F = t;
+            break;
+        }
+        case OP_9XY0:
+            if (X != Y) PC += 2;
+            break;
+        case OP_ANNN:
+            I[lane] = op.nnn;
+            break;
+        case OP_BNNN:
+            PC = op.nnn + V[0][lane];
+            break;
+        case OP_CXNN:
+            X = nextRandom(random[lane]) & op.nn;
+            break;
+        case OP_DXYN: {
+            unsigned int x = X;
+            unsigned int y = Y;
+            uint64_t collision = 0;
+            for (unsigned int row = 0; row < op.n; row++) {
+                uint64_t sprite = spriteRow(ram[(I[lane] + row) & 0xFFF], x);
+                uint64_t& line = video[lane][(y + row) % DISPLAY_HEIGHT];
+                collision |= line & sprite;
+                line ^= sprite;
+            }
+            F = (collision != 0) ? 1 : 0;
+            break;
+        }
+        case OP_EX9E:
+            if (key[lane][X & 0xF]) PC += 2;
+            break;
+        case OP_EXA1:
+            if (!key[lane][X & 0xF]) PC += 2;
+            break;
+        case OP_FX07:
+            X = delayTimer[lane];
+            break;
+        case OP_FX0A: {
+            unsigned int i = 0;
+            while (i < 16 && !key[lane][i]) i++;
+            if (i < 16) X = i;
+            else PC -= 2;
+            break;
+        }
+        case OP_FX15:
+            delayTimer[lane] = X;
+            break;
+        case OP_FX18:
+            soundTimer[lane] = X;
+            break;
+        case OP_FX1E:
+            I[lane] += X;
+            break;
+        case OP_FX29:
+            I[lane] = X * 5;
+            break;
+        case OP_FX33:
+            ram[I[lane] & 0xFFF] = X / 100;
+            ram[(I[lane] + 1) & 0xFFF] = (X / 10) % 10;
+            ram[(I[lane] + 2) & 0xFFF] = X % 10;
+            written |= 1u << lane;
+            break;
+        case OP_FX55:
+            for (unsigned int i = 0; i <= op.x; i++) {
+                ram[(I[lane] + i) & 0xFFF] = V[i][lane];
+            }
+            written |= 1u << lane;
+            if (!loadStoreQuirk) I[lane] += op.x + 1;
+            break;
+        case OP_FX65:
+            for (unsigned int i = 0; i <= op.x; i++) {
+                V[i][lane] = ram[(I[lane] + i) & 0xFFF];
+            }
+            if (!loadStoreQuirk) I[lane] += op.x + 1;
+            break;
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Chip8.h"
+
+const unsigned int LOCKSTEP_LANES { 32 };
+
+struct LockstepStats
+{
+    // Instruction fetches, one per group of lanes sharing a pc
+    uint64_t groups = 0;
+    // Lane instructions executed by the vector path and by the per-lane fallback
+    uint64_t vectorInstructions = 0;
+    uint64_t laneInstructions = 0;
+};
+
+// Runs up to 32 copies of one ROM in lockstep. Registers, I, pc and timers
+// are stored as structure-of-arrays lanes, one byte or word per machine, so
+// an ALU instruction shared by every lane is a handful of AVX2 operations
+// on CPUs that have it.
+// Each step groups the lanes by pc: lanes at the same instruction execute it
+// together under a lane mask, the rest form their own groups. Memory,
+// display, keys and stack are per lane, and instructions touching them fall
+// back to running lane by lane.
+class Chip8Lockstep
+{
+    public:
+        unsigned int cyclesPerFrame;
+        uint64_t cycleCount;
+        uint64_t frameCount;
+        LockstepStats stats;
+
+        explicit Chip8Lockstep(unsigned int lanes = LOCKSTEP_LANES);
+
+        bool loadROM(std::string romName);
+        void loadBytes(const uint8_t* data, size_t size);
+        void setQuirks(bool value);
+        void setKey(unsigned int lane, uint8_t index, bool pressed);
+        // Same sequence as Chip8::seed with the same value
+        void seed(unsigned int lane, uint64_t value);
+
+        // Run every lane for n frames, returns lane instructions executed
+        uint64_t runFrames(uint32_t n);
+
+        unsigned int lanes() const { return laneCount; }
+        bool halted(unsigned int lane) const { return !(active >> lane & 1); }
+        bool pixel(unsigned int lane, unsigned int x, unsigned int y) const;
+        // True when the lane is in the same state as a scalar machine
+        bool matches(unsigned int lane, const Chip8& chip) const;
+        // Snapshot a lane in Chip8::saveState's layout, counters included
+        size_t saveState(unsigned int lane, uint8_t* buffer, size_t size) const;
+
+    private:
+        unsigned int laneCount;
+        uint32_t active;
+        // Lanes whose memory no longer equals the loaded image
+        uint32_t written;
+        bool shiftQuirk, loadStoreQuirk;
+        // The CPU has AVX2, so the vector kernel runs
+        bool vectorPath;
+        // Steps run in total and into the current frame. Every active lane
+        // executes once per step, a halted lane keeps its counters from the
+        // step it stopped at.
+        uint64_t steps;
+        uint32_t frameStep;
+        uint64_t stoppedCycles[LOCKSTEP_LANES] = {};
+        uint64_t stoppedFrames[LOCKSTEP_LANES] = {};
+        uint32_t stoppedFrameCycle[LOCKSTEP_LANES] = {};
+
+        alignas(32) uint8_t V[REGISTERS_SIZE][LOCKSTEP_LANES] = {};
+        alignas(32) uint16_t I[LOCKSTEP_LANES] = {};
+        alignas(32) uint16_t pc[LOCKSTEP_LANES] = {};
+        alignas(32) uint8_t delayTimer[LOCKSTEP_LANES] = {};
+        alignas(32) uint8_t soundTimer[LOCKSTEP_LANES] = {};
+
+        uint8_t sp[LOCKSTEP_LANES] = {};
+        uint16_t stack[LOCKSTEP_LANES][STACK_SIZE] = {};
+        uint8_t key[LOCKSTEP_LANES][16] = {};
+        uint64_t random[LOCKSTEP_LANES] = {};
+        // One bit per pixel, pixel x of a row at bit 63 - x
+        uint64_t video[LOCKSTEP_LANES][DISPLAY_HEIGHT] = {};
+
+        // Loaded image and its decode, shared by every lane not in written
+        uint8_t image[MEMORY_SIZE] = {};
+        Instruction decoded[MEMORY_SIZE] = {};
+        std::unique_ptr<uint8_t[][MEMORY_SIZE]> memory;
+
+        void step();
+        void stop(unsigned int lane);
+        uint32_t lanesAt(uint16_t address) const;
+        uint32_t lanesAtVector(uint16_t address) const;
+        void executeGroup(Instruction instruction, uint32_t group);
+        bool executeVector(Instruction instruction, uint32_t group);
+        void executeLane(unsigned int lane, Instruction instruction);
+};
@@ -3,173 +3,167 @@
 #include <vector>
 #include <cmath>
 #include "Chip8.h"
+#include "Audio.h"
+#include "Rewind.h"
+#include "Movie.h"
+#include "Profile.h"
 
-void drawVideo(sf::RenderWindow& window, Chip8& chip, unsigned int videoScale);
+// The display as one 64x32 texture, drawn as a single scaled sprite
+struct Screen
+{
+    sf::Texture texture;
+    sf::Sprite sprite;
+    std::vector<sf::Uint8> pixels;
+};
+
+const sf::Color backgroundColor(29,30,44,255);
+const sf::Color pixelColor(232,233,235,255);
+const uint32_t ALL_ROWS = 0xFFFFFFFF;
+
+void createScreen(Screen& screen, unsigned int videoScale);
+void drawVideo(sf::RenderWindow& window, Screen& screen, const Frame& frame, uint32_t rows = ALL_ROWS);
+void drawVideoRectangles(sf::RenderWindow& window, const Frame& frame, unsigned int videoScale);
+void benchmarkDraw(sf::RenderWindow& window, Screen& screen, unsigned int videoScale);
 int keyCodeIndex(sf::Keyboard::Key keyCode);
 
-int main()
+int main(int argc, char* argv[])
 {
     Chip8 chip;
     const unsigned int videoScale = 15;
-    const float sample_rate = 44100;
-    const float frequency = 880; // 880 Hz = A5
-    const float duration = 0.1; // 0.1 seconds
     const float speed = 24;
-    const float amplitude = 30000;
-    std::vector<sf::Int16> beep;
-    std::vector<sf::Int16> beep2;
-    std::vector<sf::Int16> beep3;
-    std::vector<sf::Int16> beep4;
-
-    for (float t = 0; t < duration; t += 1 / sample_rate) {
-        float y = 0;
-        y += sin(2 * M_PI * frequency * t);
-        y += sin(2 * M_PI * frequency * 2 * t) / 2;
-        y += sin(2 * M_PI * frequency * 4 * t) / 4;
-        y += sin(2 * M_PI * frequency * 8 * t) / 8;
-        y += sin(2 * M_PI * frequency * 16 * t) / 16;
-        y /= 2; // normalize the amplitude
-
-        short sample = y * amplitude;
-        beep.push_back(sample);
-    }
-
-    for (float t = 0; t < duration; t += 1 / sample_rate) {
-        float y = 0;
-        y += sin(2 * M_PI * (frequency - 50) * t);
-        y += sin(2 * M_PI * (frequency - 50) * 2 * t) / 2;
-        y += sin(2 * M_PI * (frequency - 50) * 4 * t) / 4;
-        y += sin(2 * M_PI * (frequency - 50) * 8 * t) / 8;
-        y += sin(2 * M_PI * (frequency - 50) * 16 * t) / 16;
-        y /= 2; // normalize the amplitude
-
-        short sample = y * amplitude;
-        beep2.push_back(sample);
-    }
-
-    for (float t = 0; t < duration; t += 1 / sample_rate) {
-        float y = 0;
-        y += sin(2 * M_PI * (frequency + 50) * t);
-        y += sin(2 * M_PI * (frequency + 50) * 2 * t) / 2;
-        y += sin(2 * M_PI * (frequency + 50) * 4 * t) / 4;
-        y += sin(2 * M_PI * (frequency + 50) * 8 * t) / 8;
-        y += sin(2 * M_PI * (frequency + 50) * 16 * t) / 16;
-        y /= 2; // normalize the amplitude
-
-        short sample = y * amplitude;
-        beep3.push_back(sample);
-    }
-
-    for (float t = 0; t < duration; t += 1 / sample_rate) {
-        float y = 0;
-        y += sin(2 * M_PI * (frequency - 80) * t);
-        y += sin(2 * M_PI * (frequency - 80) * 2 * t) / 2;
-        y += sin(2 * M_PI * (frequency - 80) * 4 * t) / 4;
-        y += sin(2 * M_PI * (frequency - 80) * 8 * t) / 8;
-        y += sin(2 * M_PI * (frequency - 80) * 16 * t) / 16;
-        y /= 2; // normalize the amplitude
-
-        short sample = y * amplitude;
-        beep4.push_back(sample);
-    }
 
     sf::RenderWindow window(sf::VideoMode(DISPLAY_WIDTH * videoScale, DISPLAY_HEIGHT * videoScale), "Chip-8 Emulator");
     window.setFramerateLimit(60);
 
-    sf::SoundBuffer buffer;
-    buffer.loadFromSamples(beep.data(), beep.size(), 1, sample_rate);
-    sf::SoundBuffer buffer2;
-    buffer2.loadFromSamples(beep2.data(), beep2.size(), 1, sample_rate);
-    sf::SoundBuffer buffer3;
-    buffer3.loadFromSamples(beep3.data(), beep3.size(), 1, sample_rate);
-    sf::SoundBuffer buffer4;
-    buffer4.loadFromSamples(beep4.data(), beep4.size(), 1, sample_rate);
+    Screen screen;
+    createScreen(screen, videoScale);
+    for (int i = 1; i < argc; i++) {
+        if (std::string(argv[i]) == "--bench-draw") {
+            benchmarkDraw(window, screen, videoScale);
+            return 0;
+        }
+    }
 
-    sf::Sound sound;
-    sound.setBuffer(buffer);
-    sound.setVolume(50);
+    std::string recordPath, playPath;
+    chip.setQuirks(false);
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--jit" && !chip.setJit(true)) {
+            std::cout << "JIT not supported on this host, using the interpreter" << '\n';
+        } else if (arg == "--record" && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (arg == "--play" && i + 1 < argc) {
+            playPath = argv[++i];
+        } else if (arg == "--profile") {
+            chip.setProfiling(true);
+        }
+    }
+    chip.loadROM("golf.ch8");
 
-    sf::Sound sound2;
-    sound2.setBuffer(buffer2);
-    sound2.setVolume(50);
+    // startCycle derives the frame length from the period, a movie needs it up front
+    float period = 1.43 / speed;
+    uint64_t seed = std::random_device()();
+    chip.seed(seed);
+    Chip8Movie movie;
+    if (!playPath.empty()) {
+        if (!movie.load(playPath) || !movie.prepare(chip)) {
+            std::cout << "Can't play " << playPath << " on this ROM" << '\n';
+            return 1;
+        }
+        period = FRAME_PERIOD_MS / movie.cyclesPerFrame();
+    } else if (!recordPath.empty()) {
+        chip.cyclesPerFrame = std::max(1, int(std::lround(FRAME_PERIOD_MS / period)));
+        movie.start(chip, seed);
+    }
 
-    sf::Sound sound3;
-    sound3.setBuffer(buffer3);
-    sound3.setVolume(50);
+    // Keys are sampled at frame boundaries so a movie can replay them exactly.
+    // Hold Backspace to step back one frame per tick.
+    Chip8Rewind rewind;
+    std::atomic<bool> rewinding { false };
+    std::atomic<bool> closing { false };
+    std::atomic<uint16_t> heldKeys { 0 };
+    chip.frameHook = [&](Chip8& chip) {
+        if (closing) {
+            // Stop between frames so a recording never ends on a partial one
+            chip.halt = true;
+            return false;
+        }
+        if (rewinding) {
+            rewind.rewind(chip);
+            if (!recordPath.empty()) movie.truncate(chip.frameCount);
+            return false;
+        }
 
-    sf::Sound sound4;
-    sound4.setBuffer(buffer4);
-    sound4.setVolume(50);
+        uint16_t keys = playPath.empty() ? heldKeys.load() : movie.keysAt(chip.frameCount);
+        chip.setKeys(keys);
+        rewind.capture(chip);
+        if (!recordPath.empty()) movie.record(chip, keys);
+        return true;
+    };
 
-    chip.setQuirks(false);
-    chip.loadROM("golf.ch8");
-    
-    std::thread cpuThread([&chip, speed]() {
-        chip.startCycle(1.43 / speed);
+    std::thread cpuThread([&chip, period]() {
+        chip.startCycle(period);
     });
 
+    Chip8Audio audio(chip);
+    audio.setVolume(50);
+    audio.play();
+
     sf::Event event;
     bool isEvent = false;
-    bool isBeeping = false;
-    sf::Clock beepClock;
+    uint64_t shownSequence = 0;
     
     while (window.isOpen())
     {
-        if (isBeeping) {
-            if (beepClock.getElapsedTime().asMilliseconds() >= 100) {
-                isBeeping = false;
-            }
-        } else if (chip.soundTimer > 0) {
-            beepClock.restart();
-            switch (rand() % 4)
-            {
-                case 1:
-                    sound2.play();
-                    break;
-                case 2:
-                    sound3.play();
-                    break;
-                case 3:
-                    sound4.play();
-                    break;
-                default:
-                    sound.play();
-                    break;
-            }
-            
-            isBeeping = true;
-            chip.soundTimer = 0;
-        }
-
-        if (chip.drawFlag) {
-            chip.drawFlag = false;
-            drawVideo(window, chip, videoScale);
+        const Frame& frame = chip.latestFrame();
+        if (frame.sequence != shownSequence) {
+            // Dirty rows are relative to the previous frame, if one was skipped repaint everything
+            uint32_t rows = (frame.sequence == shownSequence + 1) ? frame.dirty.rows : ALL_ROWS;
+            shownSequence = frame.sequence;
+            drawVideo(window, screen, frame, rows);
         }
 
         while (window.pollEvent(event)) {   
             if (event.type == sf::Event::Closed) {
                 std::cout << "Closing" << std::endl;
-                chip.halt = true;
+                closing = true;
                 window.close();
+            } else if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::BackSpace) {
+                rewinding = true;
+            } else if (event.type == sf::Event::KeyReleased && event.key.code == sf::Keyboard::BackSpace) {
+                rewinding = false;
             } else if (event.type == sf::Event::KeyPressed) {
                 int index = keyCodeIndex(event.key.code);
                 //std::cout << "Key pressed " << index << std::endl;
                 if (index != -1) {
-                    chip.key[index] = 1;
+                    heldKeys |= 1 << index;
                 }
             } else if (event.type == sf::Event::KeyReleased) {
                 int index = keyCodeIndex(event.key.code);
                 //std::cout << "Key released " << index << std::endl;
                 if (index != -1) {
-                    chip.key[index] = 0;
+                    heldKeys &= ~(1 << index);
                 }
             } else if (event.type == sf::Event::Resized) {
                 //std::cout << "Refresh Video" << '\n';
-                drawVideo(window, chip, videoScale);
+                drawVideo(window, screen, chip.latestFrame());
             }
         }
     }
 
+    cpuThread.join();
+    std::cout << "Rewind: " << rewind.frames() << " frames in " << rewind.bytesUsed() / 1024.0 << " KB of "
+              << rewind.arenaSize() / 1024 << " KB, " << rewind.averageCaptureNs() << " ns per capture" << '\n';
+    if (chip.profile()) printProfile(std::cout, chip);
+
+    if (!recordPath.empty()) {
+        movie.finish(chip);
+        if (movie.save(recordPath)) {
+            std::cout << "Recorded " << movie.frames() << " frames to " << recordPath << '\n';
+        } else {
+            std::cout << "Error trying to write " << recordPath << '\n';
+        }
+    }
     return 0;
 }
 
@@ -213,23 +207,92 @@ int keyCodeIndex(sf::Keyboard::Key keyCode) {
     }
 }
 
-void drawVideo(sf::RenderWindow& window, Chip8& chip, unsigned int videoScale) {
-    window.clear(sf::Color(29,30,44,255));
+void createScreen(Screen& screen, unsigned int videoScale) {
+    screen.texture.create(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+    screen.texture.setSmooth(false);
+    screen.sprite.setTexture(screen.texture, true);
+    screen.sprite.setScale(videoScale, videoScale);
+    screen.pixels.resize(DISPLAY_WIDTH * DISPLAY_HEIGHT * 4);
+    for (size_t i = 0; i < screen.pixels.size(); i += 4) {
+        screen.pixels[i] = backgroundColor.r;
+        screen.pixels[i + 1] = backgroundColor.g;
+        screen.pixels[i + 2] = backgroundColor.b;
+        screen.pixels[i + 3] = backgroundColor.a;
+    }
+    screen.texture.update(screen.pixels.data());
+}
+
+// Expand the changed rows into RGBA, upload that band and draw one sprite
+void drawVideo(sf::RenderWindow& window, Screen& screen, const Frame& frame, uint32_t rows) {
+    if (rows != 0) {
+        unsigned int first = std::countr_zero(rows);
+        unsigned int last = 31 - std::countl_zero(rows);
 
-    for (unsigned int x=0; x < DISPLAY_WIDTH; x++)
-    {
-        for (unsigned int y=0; y < DISPLAY_HEIGHT; y++)
-        {   
-            if (chip.video[x][y])
+        sf::Uint8* pixel = screen.pixels.data() + first * DISPLAY_WIDTH * 4;
+        for (unsigned int y=first; y <= last; y++)
+        {
+            uint64_t row = frame.rows[y];
+            for (unsigned int x=0; x < DISPLAY_WIDTH; x++)
             {
-                sf::RectangleShape rectangle;
-                rectangle.setSize(sf::Vector2f(videoScale, videoScale));
-                rectangle.setFillColor(sf::Color(232,233,235,255));
-                rectangle.setPosition(x * videoScale, y * videoScale);
-                window.draw(rectangle);
+                const sf::Color& color = (row >> (63 - x) & 1) ? pixelColor : backgroundColor;
+                *pixel++ = color.r;
+                *pixel++ = color.g;
+                *pixel++ = color.b;
+                *pixel++ = color.a;
             }
         }
+        screen.texture.update(screen.pixels.data() + first * DISPLAY_WIDTH * 4, DISPLAY_WIDTH, last - first + 1, 0, first);
+    }
+
+    window.clear(backgroundColor);
+    window.draw(screen.sprite);
+    window.display();
+}
+
+// The previous renderer, one rectangle per lit pixel. Kept for benchmarkDraw.
+void drawVideoRectangles(sf::RenderWindow& window, const Frame& frame, unsigned int videoScale) {
+    window.clear(backgroundColor);
+
+    sf::RectangleShape rectangle;
+    rectangle.setSize(sf::Vector2f(videoScale, videoScale));
+    rectangle.setFillColor(pixelColor);
+
+    for (unsigned int y=0; y < DISPLAY_HEIGHT; y++)
+    {
+        // Visit only the lit pixels of the row
+        for (uint64_t row = frame.rows[y]; row != 0; row &= row - 1)
+        {
+            unsigned int x = 63 - std::countr_zero(row);
+            rectangle.setPosition(x * videoScale, y * videoScale);
+            window.draw(rectangle);
+        }
     }
 
     window.display();
 }
+
+// --bench-draw: time both renderers on a half-lit checkerboard, unthrottled
+void benchmarkDraw(sf::RenderWindow& window, Screen& screen, unsigned int videoScale) {
+    const unsigned int frames = 600;
+    Frame frame;
+    for (unsigned int y=0; y < DISPLAY_HEIGHT; y++) {
+        frame.rows[y] = (y & 1) ? 0x5555555555555555ull : 0xAAAAAAAAAAAAAAAAull;
+    }
+
+    window.setFramerateLimit(0);
+    window.setVerticalSyncEnabled(false);
+
+    sf::Clock clock;
+    for (unsigned int i = 0; i < frames; i++) {
+        drawVideoRectangles(window, frame, videoScale);
+    }
+    double rectangles = clock.restart().asMicroseconds() / 1000.0 / frames;
+
+    for (unsigned int i = 0; i < frames; i++) {
+        drawVideo(window, screen, frame);
+    }
+    double texture = clock.restart().asMicroseconds() / 1000.0 / frames;
+
+    std::cout << "Rectangles " << rectangles << " ms/frame" << '\n';
+    std::cout << "Texture    " << texture << " ms/frame" << '\n';
+}
@@ -0,0 +1,203 @@
+#include "Movie.h"
+
+const uint64_t CHAIN_START { 14695981039346656037ull };
+
+void Chip8Movie::start(const Chip8& chip, uint64_t seed)
+{
+    romHash = chip.programHash();
+    romSize = chip.programSize();
+    cyclesPerFrameValue = chip.cyclesPerFrame;
+    shiftQuirk = chip.shiftQuirk;
+    seedValue = seed;
+
+    frameTotal = 0;
+    keyRuns.clear();
+    checkpoints.clear();
+    chain.clear();
+    finalHash = 0;
+}
+
+void Chip8Movie::record(const Chip8& chip, uint16_t keys)
+{
+    uint64_t previous = chain.empty() ? CHAIN_START : chain.back();
+    chain.push_back(hashFrame(previous, chip.framebuffer()));
+
+    if (!keyRuns.empty() && keyRuns.back().keys == keys) {
+        keyRuns.back().length++;
+    } else {
+        keyRuns.push_back(KeyRun { keys, 1 });
+    }
+    frameTotal++;
+}
+
+void Chip8Movie::truncate(uint32_t frame)
+{
+    while (frameTotal > frame && !keyRuns.empty()) {
+        uint32_t drop = std::min(keyRuns.back().length, frameTotal - frame);
+        keyRuns.back().length -= drop;
+        frameTotal -= drop;
+        if (keyRuns.back().length == 0) keyRuns.pop_back();
+    }
+    chain.resize(std::min<size_t>(chain.size(), frameTotal));
+}
+
+void Chip8Movie::finish(const Chip8& chip)
+{
+    finalHash = hashFrame(chain.empty() ? CHAIN_START : chain.back(), chip.framebuffer());
+    checkpoints.clear();
+    for (uint32_t frame = MOVIE_CHECKPOINT_INTERVAL; frame <= chain.size(); frame += MOVIE_CHECKPOINT_INTERVAL) {
+        checkpoints.push_back(chain[frame - 1]);
+    }
+}
+
+static void putVarint(std::ostream& out, uint32_t value)
+{
+    while (value >= 0x80) {
+        out.put(char(uint8_t(value) | 0x80));
+        value >>= 7;
+    }
+    out.put(char(value));
+}
+
+static bool getVarint(std::istream& in, uint32_t& value)
+{
+    value = 0;
+    for (unsigned int shift = 0; shift < 35; shift += 7) {
+        int byte = in.get();
+        if (byte == EOF) return false;
+        value |= uint32_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+bool Chip8Movie::save(const std::string& path) const
+{
+    std::ofstream out(path, std::ios::binary);
+    if (out.fail()) return false;
+
+    auto put = [&out](const void* data, size_t length) {
+        out.write(static_cast<const char*>(data), length);
+    };
+
+    uint8_t flags = shiftQuirk ? 1 : 0;
+    uint8_t pad = 0;
+    uint32_t runCount = keyRuns.size();
+    put("C8MV", 4);
+    put(&MOVIE_VERSION, 2);
+    put(&flags, 1);
+    put(&pad, 1);
+    put(&romHash, 8);
+    put(&romSize, 4);
+    put(&cyclesPerFrameValue, 4);
+    put(&seedValue, 8);
+    put(&frameTotal, 4);
+    put(&runCount, 4);
+    put(&finalHash, 8);
+    for (const KeyRun& run : keyRuns) {
+        put(&run.keys, 2);
+        putVarint(out, run.length);
+    }
+    put(checkpoints.data(), checkpoints.size() * 8);
+    return !out.fail();
+}
+
+bool Chip8Movie::load(const std::string& path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (in.fail()) return false;
+
+    auto get = [&in](void* data, size_t length) {
+        in.read(static_cast<char*>(data), length);
+        return !in.fail();
+    };
+
+    char magic[4];
+    uint16_t version;
+    uint8_t flags, pad;
+    uint32_t runCount;
+    if (!get(magic, 4) || std::memcmp(magic, "C8MV", 4) != 0) return false;
+    if (!get(&version, 2) || version != MOVIE_VERSION) return false;
+    get(&flags, 1);
+    get(&pad, 1);
+    get(&romHash, 8);
+    get(&romSize, 4);
+    get(&cyclesPerFrameValue, 4);
+    get(&seedValue, 8);
+    get(&frameTotal, 4);
+    get(&runCount, 4);
+    if (!get(&finalHash, 8) || cyclesPerFrameValue == 0) return false;
+    shiftQuirk = flags & 1;
+
+    keyRuns.clear();
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < runCount; i++) {
+        KeyRun run;
+        if (!get(&run.keys, 2) || !getVarint(in, run.length)) return false;
+        keyRuns.push_back(run);
+        total += run.length;
+    }
+    if (total != frameTotal) return false;
+
+    // A run length can claim any frame count, only size the checkpoints the file holds
+    std::streampos here = in.tellg();
+    in.seekg(0, std::ios::end);
+    uint64_t remaining = in.tellg() - here;
+    in.seekg(here);
+    uint64_t checkpointCount = frameTotal / MOVIE_CHECKPOINT_INTERVAL;
+    if (in.fail() || checkpointCount * 8 > remaining) return false;
+
+    checkpoints.resize(checkpointCount);
+    chain.clear();
+    return get(checkpoints.data(), checkpoints.size() * 8);
+}
+
+bool Chip8Movie::prepare(Chip8& chip) const
+{
+    if (chip.programHash() != romHash || chip.programSize() != romSize) return false;
+
+    chip.setQuirks(shiftQuirk);
+    chip.cyclesPerFrame = cyclesPerFrameValue;
+    chip.seed(seedValue);
+    return true;
+}
+
+uint16_t Chip8Movie::keysAt(uint32_t frame) const
+{
+    for (const KeyRun& run : keyRuns) {
+        if (frame < run.length) return run.keys;
+        frame -= run.length;
+    }
+    return 0;
+}
+
+ReplayResult Chip8Movie::replay(Chip8& chip) const
+{
+    ReplayResult result;
+    if (!prepare(chip)) return result;
+    result.loaded = true;
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t hash = CHAIN_START;
+    uint32_t frame = 0;
+    for (const KeyRun& run : keyRuns) {
+        chip.setKeys(run.keys);
+        for (uint32_t i = 0; i < run.length; i++, frame++) {
+            hash = hashFrame(hash, chip.framebuffer());
+            if ((frame + 1) % MOVIE_CHECKPOINT_INTERVAL == 0 && result.firstMismatch == NO_FRAME &&
+                hash != checkpoints[frame / MOVIE_CHECKPOINT_INTERVAL]) {
+                result.firstMismatch = frame + 1 - MOVIE_CHECKPOINT_INTERVAL;
+            }
+            result.instructions += chip.runFrames(1);
+        }
+    }
+
+    hash = hashFrame(hash, chip.framebuffer());
+    if (hash != finalHash && result.firstMismatch == NO_FRAME) {
+        result.firstMismatch = frame - frame % MOVIE_CHECKPOINT_INTERVAL;
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.frames = frame;
+    result.matched = result.firstMismatch == NO_FRAME;
+    return result;
+}
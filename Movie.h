@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Chip8.h"
+
+const uint16_t MOVIE_VERSION { 1 };
+// Frames between the display hash checkpoints stored in a movie
+const unsigned int MOVIE_CHECKPOINT_INTERVAL { 60 };
+const uint32_t NO_FRAME { UINT32_MAX };
+
+// Fold one display into a running hash, a word at a time
+inline uint64_t hashFrame(uint64_t chain, const uint64_t* rows)
+{
+    for (unsigned int y = 0; y < DISPLAY_HEIGHT; y++) {
+        chain = (chain ^ rows[y]) * 0x100000001B3ull;
+        chain ^= chain >> 29;
+    }
+    return chain;
+}
+
+struct ReplayResult
+{
+    bool loaded = false;
+    bool matched = false;
+    uint32_t frames = 0;
+    // First frame of the checkpoint interval the display diverged in
+    uint32_t firstMismatch = NO_FRAME;
+    uint64_t instructions = 0;
+    double seconds = 0;
+};
+
+// Input recording of a session. Keys are sampled once per frame, before the
+// frame runs, and stored as runs of identical 16-bit masks. Together with
+// the ROM hash, CXNN seed, quirk profile and speed that fully determines
+// the run, so a replay can check itself against the display hash chain
+// recorded every MOVIE_CHECKPOINT_INTERVAL frames.
+//
+// File layout, multi-byte values in host byte order:
+//   "C8MV", version u16, flags u8 (shift quirk), pad u8,
+//   rom hash u64, rom size u32, cycles per frame u32, seed u64,
+//   frames u32, runs u32, final hash u64,
+//   runs of (keys u16, length varint), checkpoints u64[frames / interval]
+class Chip8Movie
+{
+    public:
+        // Start recording chip, freshly loaded and seeded with seed
+        void start(const Chip8& chip, uint64_t seed);
+        // Record the keys applied for the frame about to run
+        void record(const Chip8& chip, uint16_t keys);
+        // Forget frame and everything after it, for a session rewound to it
+        void truncate(uint32_t frame);
+        // Fold in the display after the last frame, call once when done
+        void finish(const Chip8& chip);
+
+        bool save(const std::string& path) const;
+        bool load(const std::string& path);
+
+        // Set up chip, loaded with the movie's ROM, to replay. False if the ROM differs.
+        bool prepare(Chip8& chip) const;
+        // Keys recorded for frame, none past the end
+        uint16_t keysAt(uint32_t frame) const;
+        // Prepare chip, run every frame and compare the display hash chain
+        ReplayResult replay(Chip8& chip) const;
+
+        uint32_t frames() const { return frameTotal; }
+        size_t runs() const { return keyRuns.size(); }
+        uint64_t seed() const { return seedValue; }
+        unsigned int cyclesPerFrame() const { return cyclesPerFrameValue; }
+
+    private:
+        struct KeyRun
+        {
+            uint16_t keys;
+            uint32_t length;
+        };
+
+        uint64_t romHash = 0;
+        uint32_t romSize = 0;
+        uint32_t cyclesPerFrameValue = DEFAULT_CYCLES_PER_FRAME;
+        uint64_t seedValue = 0;
+        bool shiftQuirk = false;
+
+        uint32_t frameTotal = 0;
+        std::vector<KeyRun> keyRuns;
+        uint64_t finalHash = 0;
+        std::vector<uint64_t> checkpoints;
+        // Hash chain up to each recorded frame, kept while recording so truncate can rewind it
+        std::vector<uint64_t> chain;
+};
@@ -0,0 +1,135 @@
+#include "Pool.h"
+
+Chip8Pool::Chip8Pool(unsigned int threads)
+{
+    threadCount = std::max(1u, threads);
+    remaining = 0;
+}
+
+Chip8& Chip8Pool::add()
+{
+    machines.push_back(std::make_unique<Chip8>());
+    return *machines.back();
+}
+
+// Load the same ROM into every instance, reading it once
+bool Chip8Pool::loadROM(std::string romName)
+{
+    std::vector<uint8_t> bytes;
+    if (!readROM(romName, bytes)) {
+        std::cout << "Error trying to open " << romName << '\n';
+        return false;
+    }
+
+    for (auto& machine : machines) {
+        machine->loadBytes(bytes.data(), bytes.size());
+    }
+    return true;
+}
+
+PoolStats Chip8Pool::run(uint32_t frames, uint32_t quantum)
+{
+    quantum = std::max(1u, quantum);
+    progress.assign(machines.size(), Progress { frames, 0, 0, 0, 0 });
+
+    // Deal instances round-robin, idle workers steal the rest
+    workers.clear();
+    for (unsigned int i = 0; i < threadCount; i++) {
+        workers.push_back(std::make_unique<Worker>());
+        workers.back()->frameUs.reserve(machines.size() * frames / quantum / threadCount + 1);
+    }
+    for (size_t i = 0; i < machines.size(); i++) {
+        if (frames > 0) workers[i % threadCount]->tasks.push_back(i);
+    }
+    remaining = (frames > 0) ? machines.size() : 0;
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned int i = 1; i < threadCount; i++) {
+        threads.emplace_back([this, i, quantum]() { work(i, quantum); });
+    }
+    work(0, quantum);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    PoolStats stats;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<float> samples;
+    for (auto& worker : workers) {
+        samples.insert(samples.end(), worker->frameUs.begin(), worker->frameUs.end());
+    }
+    if (!samples.empty()) {
+        std::sort(samples.begin(), samples.end());
+        stats.p50FrameUs = samples[samples.size() / 2];
+        stats.p99FrameUs = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+        stats.maxFrameUs = samples.back();
+    }
+
+    for (const Progress& p : progress) {
+        InstanceStats instance;
+        instance.frames = p.frames;
+        instance.meanFrameUs = p.frames ? p.totalUs / p.frames : 0;
+        instance.maxFrameUs = p.maxUs;
+        stats.instances.push_back(instance);
+        stats.instructions += p.instructions;
+        stats.frames += p.frames;
+    }
+    stats.instructionsPerSecond = stats.instructions / stats.seconds;
+    return stats;
+}
+
+// Own tasks come off the back, stolen ones off the front of another worker
+bool Chip8Pool::takeTask(unsigned int self, size_t& task)
+{
+    for (unsigned int i = 0; i < threadCount; i++) {
+        Worker& worker = *workers[(self + i) % threadCount];
+        std::lock_guard<std::mutex> guard(worker.lock);
+        if (worker.tasks.empty()) continue;
+
+        if (i == 0) {
+            task = worker.tasks.back();
+            worker.tasks.pop_back();
+        } else {
+            task = worker.tasks.front();
+            worker.tasks.pop_front();
+        }
+        return true;
+    }
+    return false;
+}
+
+void Chip8Pool::work(unsigned int self, uint32_t quantum)
+{
+    Worker& worker = *workers[self];
+    size_t task;
+
+    while (remaining > 0) {
+        if (!takeTask(self, task)) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        Chip8& machine = *machines[task];
+        Progress& p = progress[task];
+        uint32_t frames = std::min(quantum, p.framesLeft);
+
+        auto start = std::chrono::steady_clock::now();
+        p.instructions += machine.runFrames(frames);
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / frames;
+
+        worker.frameUs.push_back(us);
+        p.totalUs += us * frames;
+        p.maxUs = std::max(p.maxUs, us);
+        p.frames += frames;
+        p.framesLeft -= frames;
+
+        if (p.framesLeft > 0 && !machine.halt) {
+            std::lock_guard<std::mutex> guard(worker.lock);
+            worker.tasks.push_back(task);
+        } else {
+            remaining--;
+        }
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Chip8.h"
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+
+// Frame latency of one instance: wall time per emulated frame
+struct InstanceStats
+{
+    uint64_t frames = 0;
+    double meanFrameUs = 0;
+    double maxFrameUs = 0;
+};
+
+struct PoolStats
+{
+    uint64_t instructions = 0;
+    uint64_t frames = 0;
+    double seconds = 0;
+    double instructionsPerSecond = 0;
+    double p50FrameUs = 0;
+    double p99FrameUs = 0;
+    double maxFrameUs = 0;
+    std::vector<InstanceStats> instances;
+};
+
+// Hosts many independent machines and advances them over a work-stealing
+// thread pool, a quantum of frames per task.
+class Chip8Pool
+{
+    public:
+        explicit Chip8Pool(unsigned int threads = std::thread::hardware_concurrency());
+
+        Chip8& add();
+        bool loadROM(std::string romName);
+        size_t size() const { return machines.size(); }
+        Chip8& operator[](size_t index) { return *machines[index]; }
+
+        // Run every instance for frames frames, quantum frames per task
+        PoolStats run(uint32_t frames, uint32_t quantum = 1);
+
+    private:
+        struct Worker
+        {
+            std::mutex lock;
+            std::deque<size_t> tasks;
+            std::vector<float> frameUs;
+        };
+
+        struct Progress
+        {
+            uint32_t framesLeft;
+            uint64_t instructions;
+            double totalUs;
+            double maxUs;
+            uint64_t frames;
+        };
+
+        unsigned int threadCount;
+        std::vector<std::unique_ptr<Chip8>> machines;
+        std::vector<Progress> progress;
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::atomic<size_t> remaining;
+
+        bool takeTask(unsigned int self, size_t& task);
+        void work(unsigned int self, uint32_t quantum);
+};
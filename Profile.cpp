@@ -0,0 +1,138 @@
+#include "Profile.h"
+#include <iomanip>
+#include <sstream>
+
+static const char* const OPCODE_NAMES[OP_COUNT] = {
+    "----", "HALT", "NOP",
+    "00E0", "00EE",
+    "1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "6XNN", "7XNN",
+    "8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7", "8XYE",
+    "9XY0", "ANNN", "BNNN", "CXNN", "DXYN",
+    "EX9E", "EXA1",
+    "FX07", "FX0A", "FX15", "FX18", "FX1E", "FX29", "FX33", "FX55", "FX65",
+};
+
+const char* opcodeName(uint8_t op)
+{
+    return (op < OP_COUNT) ? OPCODE_NAMES[op] : "????";
+}
+
+struct HotLoop
+{
+    uint16_t head;
+    uint16_t tail;
+    uint64_t iterations;
+    uint64_t instructions;
+};
+
+static double percent(uint64_t part, uint64_t total)
+{
+    return total ? 100.0 * part / total : 0;
+}
+
+static std::string hex(unsigned int value, int width)
+{
+    std::ostringstream text;
+    text << std::uppercase << std::hex << std::setw(width) << std::setfill('0') << value;
+    return text.str();
+}
+
+static std::string instructionAt(const Chip8& chip, unsigned int address)
+{
+    return hex(chip.peek(address) << 8 | chip.peek(address + 1), 4);
+}
+
+void printProfile(std::ostream& out, const Chip8& chip, unsigned int top)
+{
+    const Chip8Profile* profile = chip.profile();
+    if (!profile) {
+        out << "Profiling was off" << '\n';
+        return;
+    }
+
+    uint64_t total = 0;
+    for (uint64_t count : profile->opcodes) total += count;
+    out << std::fixed << std::setprecision(2);
+    out << "Profile      " << total << " instructions over " << profile->frames << " frames" << '\n';
+
+    // Flat profile by opcode class
+    std::vector<uint8_t> ops;
+    for (uint8_t op = 0; op < OP_COUNT; op++) {
+        if (profile->opcodes[op]) ops.push_back(op);
+    }
+    std::sort(ops.begin(), ops.end(), [&](uint8_t a, uint8_t b) { return profile->opcodes[a] > profile->opcodes[b]; });
+    out << '\n' << "Opcode          Count       %" << '\n';
+    for (uint8_t op : ops) {
+        out << "  " << opcodeName(op) << std::setw(15) << profile->opcodes[op]
+            << std::setw(8) << percent(profile->opcodes[op], total) << '\n';
+    }
+
+    // Flat profile by address
+    std::vector<uint16_t> addresses;
+    for (unsigned int address = 0; address < MEMORY_SIZE; address++) {
+        if (profile->addresses[address]) addresses.push_back(address);
+    }
+    std::stable_sort(addresses.begin(), addresses.end(),
+              [&](uint16_t a, uint16_t b) { return profile->addresses[a] > profile->addresses[b]; });
+    out << '\n' << "Address  Instr           Count       %" << '\n';
+    for (size_t i = 0; i < std::min<size_t>(top, addresses.size()); i++) {
+        uint16_t address = addresses[i];
+        out << "  " << hex(address, 3) << "    " << instructionAt(chip, address) << std::setw(16)
+            << profile->addresses[address] << std::setw(8) << percent(profile->addresses[address], total) << '\n';
+    }
+
+    // A backward jump or skip from tail to head closes a loop over [head, tail].
+    // Its instructions are those at addresses in that range, so loops nested
+    // in it count but subroutines it calls outside the range do not.
+    std::vector<HotLoop> loops;
+    for (unsigned int tail = 0; tail < MEMORY_SIZE; tail++) {
+        if (!profile->backEdges[tail]) continue;
+        HotLoop loop { profile->backTargets[tail], uint16_t(tail), profile->backEdges[tail], 0 };
+        for (unsigned int address = loop.head; address <= tail; address++) {
+            loop.instructions += profile->addresses[address];
+        }
+        loops.push_back(loop);
+    }
+    std::stable_sort(loops.begin(), loops.end(), [](const HotLoop& a, const HotLoop& b) { return a.instructions > b.instructions; });
+    out << '\n' << "Loop         Iterations    Instructions       %      Per trip" << '\n';
+    for (size_t i = 0; i < std::min<size_t>(top, loops.size()); i++) {
+        const HotLoop& loop = loops[i];
+        out << "  " << hex(loop.head, 3) << "-" << hex(loop.tail, 3) << std::setw(13) << loop.iterations
+            << std::setw(16) << loop.instructions << std::setw(8) << percent(loop.instructions, total)
+            << std::setw(14) << double(loop.instructions) / loop.iterations;
+        if (loop.head == loop.tail) {
+            bool keyWait = (chip.peek(loop.head) & 0xF0) == 0xF0 && chip.peek(loop.head + 1) == 0x0A;
+            out << "  " << (keyWait ? "key wait" : "jump to self");
+        }
+        out << '\n';
+    }
+
+    // DXYN work and when in the frame the display was done
+    double frames = std::max<uint64_t>(profile->frames, 1);
+    out << '\n' << "Sprites      " << profile->sprites << " (" << profile->sprites / frames << " per frame), "
+        << profile->spriteRows << " rows, " << profile->spritePixels << " lit pixels ("
+        << profile->spritePixels / frames << " per frame)" << '\n';
+    if (profile->drawingFrames) {
+        out << "Last draw    " << double(profile->lastDrawCycles) / profile->drawingFrames << " instructions into the frame on average, "
+            << profile->drawingFrames << " of " << profile->frames << " frames drew" << '\n';
+        for (unsigned int bucket = 0; bucket < DRAW_HISTOGRAM_BUCKETS; bucket++) {
+            out << "  " << bucket << "/" << DRAW_HISTOGRAM_BUCKETS << "-" << bucket + 1 << "/" << DRAW_HISTOGRAM_BUCKETS
+                << " of the frame" << std::setw(10) << profile->lastDrawHistogram[bucket] << '\n';
+        }
+    }
+
+    // Call stack depth
+    unsigned int deepest = 0;
+    uint64_t calls = 0;
+    for (unsigned int depth = 1; depth <= STACK_SIZE; depth++) {
+        if (profile->callDepths[depth]) deepest = depth;
+        calls += profile->callDepths[depth];
+    }
+    out << '\n' << "Calls        " << calls << ", deepest stack " << deepest << " of " << STACK_SIZE;
+    if (profile->stackOverflows) out << ", " << profile->stackOverflows << " overflowed";
+    out << '\n';
+    for (unsigned int depth = 1; depth <= deepest; depth++) {
+        out << "  depth " << std::setw(2) << depth << std::setw(14) << profile->callDepths[depth] << '\n';
+    }
+    out << std::defaultfloat << std::setprecision(6);
+}
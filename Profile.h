@@ -0,0 +1,12 @@
+#pragma once
+
+#include "Chip8.h"
+
+// Name of a dispatch table handler, "8XY4" style
+const char* opcodeName(uint8_t op);
+
+// Report the counters of a machine run with setProfiling(true): a flat
+// profile by opcode class and by address, the hottest loops found from the
+// backward jumps taken, DXYN work, when in the frame the display was
+// finished, and call stack depth. Shows the top entries of each list.
+void printProfile(std::ostream& out, const Chip8& chip, unsigned int top = 16);
@@ -0,0 +1,20 @@
+#include "Recompiled.h"
+
+static std::vector<const RecompiledProgram*>& registry()
+{
+    static std::vector<const RecompiledProgram*> programs;
+    return programs;
+}
+
+void registerRecompiled(const RecompiledProgram* program)
+{
+    registry().push_back(program);
+}
+
+const RecompiledProgram* findRecompiled(uint64_t romHash, uint32_t romSize, bool shiftQuirk)
+{
+    for (const RecompiledProgram* program : registry()) {
+        if (program->romHash == romHash && program->romSize == romSize && program->shiftQuirk == shiftQuirk) return program;
+    }
+    return nullptr;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Chip8.h"
+
+struct RecompiledBlockEntry
+{
+    uint16_t address;
+    uint8_t length;
+    RecompiledBlock run;
+};
+
+// A ROM translated ahead of time. Blocks are only used while the bytes they
+// were generated from are untouched, anything else runs in the interpreter.
+struct RecompiledProgram
+{
+    const char* romName;
+    uint64_t romHash;
+    uint32_t romSize;
+    bool shiftQuirk;
+    const RecompiledBlockEntry* blocks;
+    size_t blockCount;
+};
+
+// Generated translation units register themselves at static init time
+void registerRecompiled(const RecompiledProgram* program);
+const RecompiledProgram* findRecompiled(uint64_t romHash, uint32_t romSize, bool shiftQuirk);
+
+// The slice of the core that generated code and the recompiler work against
+struct Chip8Runtime
+{
+    static uint8_t* V(Chip8& chip) { return chip.V; }
+    static uint16_t& I(Chip8& chip) { return chip.I; }
+    static uint16_t& pc(Chip8& chip) { return chip.pc; }
+    static uint8_t delayTimer(Chip8& chip) { return chip.delayTimer; }
+    static bool shiftQuirk(Chip8& chip) { return chip.shiftQuirk; }
+
+    // Runs the instruction at address in the interpreter, non-zero when the
+    // block starting at start has to stop
+    static uint32_t execute(Chip8& chip, uint16_t address, uint16_t start)
+    {
+        return Chip8::jitExecute(&chip, address | (uint32_t(start) << 16));
+    }
+
+    static Instruction instructionAt(Chip8& chip, uint16_t address) { return chip.fetch(address); }
+    static uint16_t wordAt(Chip8& chip, uint16_t address) { return (uint16_t(chip.memory[address]) << 8) | chip.memory[address + 1]; }
+    static uint8_t blockLengthAt(Chip8& chip, uint16_t address)
+    {
+        return chip.blockLength[address] ? chip.blockLength[address] : chip.buildBlock(address);
+    }
+    static bool endsBlock(uint8_t op) { return Chip8::endsBlock(op); }
+};
@@ -0,0 +1,242 @@
+#include "Recompiled.h"
+
+#include <set>
+#include <sstream>
+#include <iomanip>
+#include <cctype>
+#include <algorithm>
+
+// chip8-recomp: translates the code reachable from 0x200 in a ROM into a C++
+// translation unit. Link the output with the core and loadROM picks it up.
+//
+//     chip8-recomp roms/golf.ch8 golf_recompiled.cpp [--quirks]
+
+static std::string hex(unsigned int value, int width)
+{
+    std::ostringstream out;
+    out << "0x" << std::uppercase << std::hex << std::setw(width) << std::setfill('0') << value;
+    return out.str();
+}
+
+static std::string fileName(std::string path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return (slash == std::string::npos) ? path : path.substr(slash + 1);
+}
+
+// One symbol per ROM and quirk, so both variants of a ROM can be linked in
+static std::string symbolFor(std::string path, bool quirks)
+{
+    path = fileName(path);
+    size_t dot = path.find_last_of('.');
+    if (dot != std::string::npos) path = path.substr(0, dot);
+
+    std::string symbol = "recompiled_";
+    for (char c : path) {
+        symbol += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+    }
+    if (quirks) symbol += "_quirks";
+    return symbol;
+}
+
+// C++ for one instruction, mirroring the op_* handlers in Chip8.cpp
+static std::string translate(Chip8& chip, uint16_t at, uint16_t start, unsigned int index, unsigned int length)
+{
+    Instruction instruction = Chip8Runtime::instructionAt(chip, at);
+    Operands op = instruction.operands;
+    std::string x = "V[" + hex(op.x, 1) + "]";
+    std::string y = "V[" + hex(op.y, 1) + "]";
+    std::string shifted = Chip8Runtime::shiftQuirk(chip) ? x : y;
+    std::string nn = hex(op.nn, 2);
+    std::string skip = hex(at + 4, 4) + " : " + hex(at + 2, 4);
+    bool last = index + 1 == length;
+
+    std::string code;
+    switch (instruction.op) {
+        case OP_NOP:
+            code = ";";
+            break;
+        case OP_6XNN:
+            code = x + " = " + nn + ";";
+            break;
+        case OP_7XNN:
+            code = x + " += " + nn + ";";
+            break;
+        case OP_8XY0:
+            code = x + " = " + y + ";";
+            break;
+        case OP_8XY1:
+            code = x + " |= " + y + ";";
+            break;
+        case OP_8XY2:
+            code = x + " &= " + y + ";";
+            break;
+        case OP_8XY3:
+            code = x + " ^= " + y + ";";
+            break;
+        case OP_8XY4:
+            code = "{ uint16_t sum = " + x + " + " + y + "; " + x + " = sum & 0xFF; V[0xF] = sum > 0xFF; }";
+            break;
+        case OP_8XY5:
+            code = "{ uint8_t t = " + x + " >= " + y + "; " + x + " -= " + y + "; V[0xF] = t; }";
+            break;
+        case OP_8XY6:
+            code = "{ uint8_t t = " + shifted + " & 0x1; " + x + " = " + shifted + " >> 1; V[0xF] = t; }";
+            break;
+        case OP_8XY7:
+            code = x + " = " + y + " - " + x + "; V[0xF] = " + y + " > " + x + ";";
+            break;
+        case OP_8XYE:
+            code = "{ uint8_t t = " + shifted + " >> 7; " + x + " = " + shifted + " << 1; V[0xF] = t; }";
+            break;
+        case OP_ANNN:
+            code = "I = " + hex(op.nnn, 3) + ";";
+            break;
+        case OP_FX07:
+            code = x + " = Chip8Runtime::delayTimer(chip);";
+            break;
+        case OP_FX1E:
+            code = "I += " + x + ";";
+            break;
+        case OP_FX29:
+            code = "I = " + x + " * 5;";
+            break;
+        case OP_1NNN:
+            return "pc = " + hex(op.nnn, 4) + "; return " + std::to_string(length) + ";";
+        case OP_3XNN:
+            return "pc = (" + x + " == " + nn + ") ? " + skip + "; return " + std::to_string(length) + ";";
+        case OP_4XNN:
+            return "pc = (" + x + " != " + nn + ") ? " + skip + "; return " + std::to_string(length) + ";";
+        case OP_5XY0:
+            return "pc = (" + x + " == " + y + ") ? " + skip + "; return " + std::to_string(length) + ";";
+        case OP_9XY0:
+            return "pc = (" + x + " != " + y + ") ? " + skip + "; return " + std::to_string(length) + ";";
+        default:
+            // Everything else runs in the interpreter, which also sets pc
+            std::string call = "Chip8Runtime::execute(chip, " + hex(at, 4) + ", " + hex(start, 4) + ")";
+            if (last) return call + "; return " + std::to_string(length) + ";";
+            return "if (" + call + ") return " + std::to_string(index + 1) + ";";
+    }
+
+    if (last) code += " pc = " + hex(at + 2, 4) + "; return " + std::to_string(length) + ";";
+    return code;
+}
+
+// Addresses execution can continue at after the block ending at last
+static void successors(Chip8& chip, uint16_t last, std::set<uint16_t>& pending)
+{
+    Instruction instruction = Chip8Runtime::instructionAt(chip, last);
+    switch (instruction.op) {
+        case OP_1NNN:
+            pending.insert(instruction.operands.nnn);
+            break;
+        case OP_2NNN:
+            pending.insert(instruction.operands.nnn);
+            pending.insert(last + 2);
+            break;
+        case OP_3XNN:
+        case OP_4XNN:
+        case OP_5XY0:
+        case OP_9XY0:
+        case OP_EX9E:
+        case OP_EXA1:
+            pending.insert(last + 2);
+            pending.insert(last + 4);
+            break;
+        case OP_FX0A:
+            pending.insert(last);
+            pending.insert(last + 2);
+            break;
+        case OP_00EE:
+        case OP_BNNN:
+        case OP_HALT:
+            // Return addresses come from 2NNN, computed jumps fall back to the interpreter
+            break;
+        default:
+            pending.insert(last + 2);
+            break;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string romPath, outputPath;
+    bool quirks = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--quirks") quirks = true;
+        else if (romPath.empty()) romPath = arg;
+        else outputPath = arg;
+    }
+    if (romPath.empty()) {
+        std::cout << "usage: chip8-recomp <rom.ch8> [output.cpp] [--quirks]" << '\n';
+        return 1;
+    }
+
+    std::ifstream input(romPath, std::ios::binary);
+    if (input.fail()) {
+        std::cout << "Error trying to open " << romPath << '\n';
+        return 1;
+    }
+    std::vector<char> bytes((std::istreambuf_iterator<char>(input)), (std::istreambuf_iterator<char>()));
+
+    Chip8 chip;
+    chip.setQuirks(quirks);
+    chip.loadBytes(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+    uint32_t romSize = std::min<size_t>(bytes.size(), MEMORY_SIZE - 0x200);
+    uint64_t romHash = hashBytes(reinterpret_cast<const uint8_t*>(bytes.data()), romSize);
+
+    std::string symbol = symbolFor(romPath, quirks);
+    if (outputPath.empty()) outputPath = symbol + ".cpp";
+
+    std::set<uint16_t> pending { 0x200 };
+    std::set<uint16_t> starts;
+    while (!pending.empty()) {
+        uint16_t address = *pending.begin();
+        pending.erase(pending.begin());
+        if (starts.count(address) || address + 1 >= MEMORY_SIZE) continue;
+
+        starts.insert(address);
+        unsigned int length = Chip8Runtime::blockLengthAt(chip, address);
+        successors(chip, address + 2 * (length - 1), pending);
+    }
+
+    std::ofstream out(outputPath);
+    out << "// Generated by chip8-recomp from " << romPath << ", do not edit.\n";
+    out << "// Compile with -O2 and link with the Chip8 core.\n";
+    out << "#include \"Recompiled.h\"\n\n";
+    out << "namespace\n{\n";
+
+    for (uint16_t start : starts) {
+        unsigned int length = Chip8Runtime::blockLengthAt(chip, start);
+        out << "\nunsigned int block_" << hex(start, 4).substr(2) << "(Chip8& chip)\n{\n";
+        out << "    uint8_t* V = Chip8Runtime::V(chip);\n";
+        out << "    uint16_t& I = Chip8Runtime::I(chip);\n";
+        out << "    uint16_t& pc = Chip8Runtime::pc(chip);\n";
+        out << "    (void)V; (void)I; (void)pc;\n\n";
+
+        for (unsigned int i = 0; i < length; i++) {
+            uint16_t at = start + 2 * i;
+            std::string code = translate(chip, at, start, i, length);
+            out << "    " << std::left << std::setw(72) << code << " // " << hex(at, 4).substr(2)
+                << ": " << hex(Chip8Runtime::wordAt(chip, at), 4).substr(2) << '\n';
+        }
+        out << "}\n";
+    }
+
+    out << "\nconst RecompiledBlockEntry blocks[] =\n{\n";
+    for (uint16_t start : starts) {
+        out << "    { " << hex(start, 4) << ", " << unsigned(Chip8Runtime::blockLengthAt(chip, start))
+            << ", block_" << hex(start, 4).substr(2) << " },\n";
+    }
+    out << "};\n\n}\n\n";
+
+    out << "extern const RecompiledProgram " << symbol << " =\n{\n";
+    out << "    \"" << fileName(romPath) << "\", "
+        << "0x" << std::hex << romHash << std::dec << "ull, " << romSize << ", "
+        << (quirks ? "true" : "false") << ", blocks, sizeof(blocks) / sizeof(blocks[0])\n};\n\n";
+    out << "static const bool registered = (registerRecompiled(&" << symbol << "), true);\n";
+
+    std::cout << "Wrote " << starts.size() << " blocks to " << outputPath << '\n';
+    return 0;
+}
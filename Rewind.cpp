@@ -0,0 +1,217 @@
+#include "Rewind.h"
+
+// Bytes of unchanged state that end a literal run
+const unsigned int MIN_ZERO_RUN { 4 };
+
+Chip8Rewind::Chip8Rewind(size_t arenaSize, unsigned int maxFrames, unsigned int keyframeInterval)
+{
+    // A keyframe has to fit even when it compresses to nothing
+    arena.resize(std::max(arenaSize, sizeof(encoded)));
+    entries.resize(std::max(1u, maxFrames));
+    interval = std::max(1u, keyframeInterval);
+    captureCount = 0;
+    captureNs = 0;
+    clear();
+}
+
+void Chip8Rewind::clear()
+{
+    first = 0;
+    count = 0;
+    head = 0;
+    used = 0;
+    sinceKeyframe = 0;
+    keyframeValid = false;
+}
+
+void Chip8Rewind::capture(const Chip8& chip)
+{
+    auto start = std::chrono::steady_clock::now();
+    chip.saveState(state, STATE_SIZE);
+
+    if (count == entries.size()) dropOldestGroup();
+    bool isKeyframe = !keyframeValid || sinceKeyframe >= interval;
+    size_t size = encode(state, isKeyframe ? nullptr : keyframe, encoded);
+
+    size_t offset = allocate(size);
+    while (offset == SIZE_MAX) {
+        // Dropping the group this delta is against turns it into a keyframe
+        bool lastGroup = true;
+        for (unsigned int i = 1; i < count; i++) {
+            if (entryAt(i).keyframe) lastGroup = false;
+        }
+        dropOldestGroup();
+        if (lastGroup && !isKeyframe) {
+            isKeyframe = true;
+            size = encode(state, nullptr, encoded);
+        }
+        offset = allocate(size);
+    }
+
+    std::copy(encoded, encoded + size, arena.data() + offset);
+    head = offset + size;
+    used += size;
+    entryAt(count) = Entry { uint32_t(offset), uint32_t(size), isKeyframe };
+    count++;
+
+    if (isKeyframe) {
+        std::copy(state, state + STATE_SIZE, keyframe);
+        keyframeValid = true;
+        sinceKeyframe = 1;
+    } else {
+        sinceKeyframe++;
+    }
+
+    captureCount++;
+    captureNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool Chip8Rewind::rewind(Chip8& chip)
+{
+    if (count == 0) return false;
+
+    Entry entry = entryAt(count - 1);
+    decode(arena.data() + entry.offset, entry.keyframe ? nullptr : keyframe, state);
+    chip.loadState(state, STATE_SIZE);
+
+    count--;
+    head = count ? entry.offset : 0;
+    used -= entry.size;
+    if (entry.keyframe) {
+        decodeKeyframeFor(count);
+    } else {
+        sinceKeyframe--;
+    }
+    return true;
+}
+
+// First offset where size bytes fit after the newest entry, SIZE_MAX if none
+size_t Chip8Rewind::allocate(size_t size)
+{
+    if (count == 0) return 0;
+
+    size_t tail = entryAt(0).offset;
+    if (head >= tail) {
+        if (arena.size() - head >= size) return head;
+        if (tail > size) return 0;
+        return SIZE_MAX;
+    }
+    return (tail - head > size) ? head : SIZE_MAX;
+}
+
+// Drop the oldest keyframe and every delta that depends on it
+void Chip8Rewind::dropOldestGroup()
+{
+    do {
+        used -= entryAt(0).size;
+        first = (first + 1) % entries.size();
+        count--;
+    } while (count > 0 && !entryAt(0).keyframe);
+
+    if (count == 0) clear();
+}
+
+// Reload the keyframe of the group ending at entry index - 1
+void Chip8Rewind::decodeKeyframeFor(unsigned int index)
+{
+    keyframeValid = false;
+    sinceKeyframe = 0;
+    for (unsigned int i = index; i > 0; i--) {
+        const Entry& entry = entryAt(i - 1);
+        if (entry.keyframe) {
+            decode(arena.data() + entry.offset, nullptr, keyframe);
+            keyframeValid = true;
+            sinceKeyframe = index - (i - 1);
+            return;
+        }
+    }
+}
+
+static uint8_t* putVarint(uint8_t* out, size_t value)
+{
+    while (value >= 0x80) {
+        *out++ = uint8_t(value) | 0x80;
+        value >>= 7;
+    }
+    *out++ = uint8_t(value);
+    return out;
+}
+
+static const uint8_t* getVarint(const uint8_t* in, size_t& value)
+{
+    value = 0;
+    for (unsigned int shift = 0; ; shift += 7) {
+        uint8_t byte = *in++;
+        value |= size_t(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return in;
+    }
+}
+
+// XOR against reference (zeros when null), then code as alternating
+// [unchanged run][literal run + bytes] pairs. Returns the encoded size.
+size_t Chip8Rewind::encode(const uint8_t* data, const uint8_t* reference, uint8_t* out)
+{
+    if (reference) {
+        // A word at a time, the compiler leaves the byte loop scalar at -O2
+        size_t i = 0;
+        for (; i + 8 <= STATE_SIZE; i += 8) {
+            uint64_t a, b;
+            std::memcpy(&a, data + i, 8);
+            std::memcpy(&b, reference + i, 8);
+            a ^= b;
+            std::memcpy(delta + i, &a, 8);
+        }
+        for (; i < STATE_SIZE; i++) delta[i] = data[i] ^ reference[i];
+    } else {
+        std::copy(data, data + STATE_SIZE, delta);
+    }
+
+    uint8_t* start = out;
+    size_t position = 0;
+    while (position < STATE_SIZE) {
+        // Most of a frame's delta is zero, skip it a word at a time
+        size_t zeros = position;
+        uint64_t word;
+        while (position + 8 <= STATE_SIZE) {
+            std::memcpy(&word, delta + position, 8);
+            if (word != 0) break;
+            position += 8;
+        }
+        while (position < STATE_SIZE && delta[position] == 0) position++;
+        zeros = position - zeros;
+
+        size_t literal = position;
+        while (position < STATE_SIZE) {
+            size_t run = 0;
+            while (run < MIN_ZERO_RUN && position + run < STATE_SIZE && delta[position + run] == 0) run++;
+            if (run == MIN_ZERO_RUN || position + run == STATE_SIZE) break;
+            position += run + 1;
+        }
+
+        out = putVarint(out, zeros);
+        out = putVarint(out, position - literal);
+        out = std::copy(delta + literal, delta + position, out);
+    }
+    return out - start;
+}
+
+void Chip8Rewind::decode(const uint8_t* in, const uint8_t* reference, uint8_t* data)
+{
+    size_t position = 0;
+    while (position < STATE_SIZE) {
+        size_t zeros, literal;
+        in = getVarint(in, zeros);
+        in = getVarint(in, literal);
+        if (reference) {
+            std::copy(reference + position, reference + position + zeros, data + position);
+            position += zeros;
+            for (size_t i = 0; i < literal; i++, position++) data[position] = *in++ ^ reference[position];
+        } else {
+            std::fill(data + position, data + position + zeros, 0);
+            position += zeros;
+            std::copy(in, in + literal, data + position);
+            in += literal;
+            position += literal;
+        }
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Chip8.h"
+
+const size_t DEFAULT_REWIND_ARENA { 512 * 1024 };
+const unsigned int DEFAULT_REWIND_FRAMES { 60 * 60 };
+const unsigned int DEFAULT_KEYFRAME_INTERVAL { 60 };
+
+// Keeps the most recent frames of a session in a fixed arena. Every
+// keyframeInterval frames a keyframe is stored; the frames in between are
+// stored as the XOR of their save state with that keyframe, run-length
+// coded so the unchanged bytes cost almost nothing. Keyframes are coded the
+// same way against an all-zero state. When the arena or the frame ring is
+// full the oldest keyframe and its deltas are dropped together.
+class Chip8Rewind
+{
+    public:
+        explicit Chip8Rewind(size_t arenaSize = DEFAULT_REWIND_ARENA,
+                             unsigned int maxFrames = DEFAULT_REWIND_FRAMES,
+                             unsigned int keyframeInterval = DEFAULT_KEYFRAME_INTERVAL);
+
+        // Store the current state as the newest frame
+        void capture(const Chip8& chip);
+        // Restore the newest frame and drop it, false when there is none left
+        bool rewind(Chip8& chip);
+        void clear();
+
+        unsigned int frames() const { return count; }
+        size_t bytesUsed() const { return used; }
+        size_t arenaSize() const { return arena.size(); }
+        uint64_t captures() const { return captureCount; }
+        double averageCaptureNs() const { return captureCount ? captureNs / captureCount : 0; }
+
+    private:
+        struct Entry
+        {
+            uint32_t offset;
+            uint32_t size;
+            bool keyframe;
+        };
+
+        std::vector<uint8_t> arena;
+        std::vector<Entry> entries;
+        unsigned int first;
+        unsigned int count;
+        unsigned int interval;
+        unsigned int sinceKeyframe;
+        // Where the next entry goes and where the oldest one starts
+        size_t head;
+        size_t used;
+        // Decoded keyframe of the newest group
+        uint8_t keyframe[STATE_SIZE];
+        bool keyframeValid;
+
+        uint8_t state[STATE_SIZE];
+        uint8_t delta[STATE_SIZE];
+        uint8_t encoded[STATE_SIZE * 2 + 16];
+
+        uint64_t captureCount;
+        double captureNs;
+
+        Entry& entryAt(unsigned int index) { return entries[(first + index) % entries.size()]; }
+        size_t allocate(size_t size);
+        void dropOldestGroup();
+        void decodeKeyframeFor(unsigned int index);
+
+        size_t encode(const uint8_t* data, const uint8_t* reference, uint8_t* out);
+        static void decode(const uint8_t* in, const uint8_t* reference, uint8_t* data);
+};